@@ -1,5 +1,7 @@
 #pragma once
 
+#include <math.h>
+
 // See also MPU-9250 Register Map and Descriptions, Revision 4.0, RM-MPU-9250A-00, Rev. 1.4, 9/9/2013 for registers not listed in
 // above document; the MPU9250 and MPU9150 are virtually identical but the latter has a different register map
 //
@@ -169,10 +171,29 @@ enum Mscale {
     MFS_16BITS      // 0.15 mG per LSB
 };
 
+// Accelerometer wake-up rate in low-power (cycle) mode, LP_ACCEL_ODR register
+enum LPAccelODR {
+    LP_ACCEL_ODR_0_24HZ = 0,
+    LP_ACCEL_ODR_0_49HZ,
+    LP_ACCEL_ODR_0_98HZ,
+    LP_ACCEL_ODR_1_95HZ,
+    LP_ACCEL_ODR_3_91HZ,
+    LP_ACCEL_ODR_7_81HZ,
+    LP_ACCEL_ODR_15_63HZ,
+    LP_ACCEL_ODR_31_25HZ,
+    LP_ACCEL_ODR_62_50HZ,
+    LP_ACCEL_ODR_125HZ,
+    LP_ACCEL_ODR_250HZ,
+    LP_ACCEL_ODR_500HZ
+};
+
 // parameters for 6 DoF sensor fusion calculations
 const float G = 9.80665f; // 1 g = 1 metre per second squared
 const float PI = 3.14159265358979323846f;
 const float DEG_TO_RAD = PI / 180.0f;
+const float TEMP_SENSITIVITY = 333.87f;  // LSB/degC, TEMP_degC = TEMP_OUT / TEMP_SENSITIVITY + TEMP_OFFSET
+const float TEMP_OFFSET = 21.0f;
+#define TEMP_BIAS_UPDATE_LSB 33         // look up the temperature biases again after a change of about 0.1 degC
 const float GyroMeasError = PI * (60.0f / 180.0f);        // gyroscope measurement error in rads/s (start at 60 deg/s), then reduce after ~10 s to 3
 const float BETA = sqrt(3.0f / 4.0f) * GyroMeasError;     // compute beta
 const float GyroMeasDrift = PI * (1.0f / 180.0f);         // gyroscope measurement drift in rad/s/s (start at 0.0 deg/s/s)
@@ -5,26 +5,85 @@
 #include "mbed.h"
 #include <math.h>
 #include "mpu-9250/MPU9250-common.hpp"
+#include "mpu-9250/fixed_point.hpp"
+#include "mpu-9250/i2c_bus.hpp"
+#include "mpu-9250/i2c_stats.hpp"
+#include "mpu-9250/madgwick.hpp"
+#include "mpu-9250/register_shadow.hpp"
+#include "mpu-9250/bias_table.hpp"
+#include "mpu-9250/mounting.hpp"
+#include "mpu-9250/text_format.hpp"
+
+// Build with MPU9250_FUSION_FIXED_POINT=1 to scale samples and run the Madgwick filter in Q-format integer arithmetic
+// (see fixed_point.hpp). The output buffers of getAccelGyro(), getMag() and performMadgwickQuaternionUpdate() then hold
+// int32_t Q15.16 values instead of float; use outputToFloat() to read them in either build.
+#ifndef MPU9250_FUSION_FIXED_POINT
+#define MPU9250_FUSION_FIXED_POINT 0
+#endif
+#include "mpu-9250/sample_frame.hpp"
+
+// Mounting of the MPU9250 (see mounting.hpp): accel/gyro axes to the NED body frame (x forward, y right, z down) of
+// getAccelGyro(), getMag() and the fusion. The default is the breakout of this example with +y accel/gyro forward
+// (north), +x to the right (east) and +z up. Set it for the board, e.g. -DMPU9250_MOUNT="AxisMount<MOUNT_X,-MOUNT_Y,-MOUNT_Z>".
+#ifndef MPU9250_MOUNT
+#define MPU9250_MOUNT AxisMount<MOUNT_Y, MOUNT_X, -MOUNT_Z>
+#endif
+
+// AK8963 axes in MPU9250 accel/gyro axes: x and y swapped, z opposite
+typedef AxisMount<MOUNT_Y, MOUNT_X, -MOUNT_Z> AK8963Axes;
+
+// Largest burst of writeBytes() and number of settings of applyConfig()
+#define MPU9250_CONFIG_MAX 16
+
+// Longest time an asynchronous sample transfer may take before it is aborted and reported as a fault
+#define MPU9250_ASYNC_TIMEOUT_MS 10
+
+// FIFO size of the MPU9250 and largest number of accelerometer samples taken by one readAccelFifo() burst
+#define MPU9250_FIFO_SIZE 512
+#define MPU9250_FIFO_BURST 32
 
 class MPU9250 {
+    typedef MPU9250_MOUNT Mount;
+    typedef ComposedMount<Mount, AK8963Axes>::type MagMount;
+
     I2C* _i2c;
+    I2CBus* _bus;                           // shared bus manager, NULL when the sensor owns `_i2c` alone
     uint8_t _busId;
+    uint8_t _address;                       // 8-bit device address, MPU9250_ADDRESS unless given to the constructor
+    bool _magAuxMaster = false;             // read the AK8963 through the MPU9250 auxiliary I2C master instead of bypass
     uint8_t _Ascale = AFS_2G;               // AFS_2G, AFS_4G, AFS_8G, AFS_16G
-    uint8_t _Gscale = GFS_250DPS;           // GFS_250DPS, GFS_500DPS, GFS_1000DPS, GFS_2000DPS
+    uint8_t _Gscale = GFS_500DPS;           // GFS_250DPS, GFS_500DPS, GFS_1000DPS, GFS_2000DPS
     uint8_t _Mscale = MFS_16BITS;           // MFS_14BITS or MFS_16BITS, 14-bit or 16-bit magnetometer resolution
     uint8_t _Mmode = 0x06;                  // Either 8 Hz (0x02/Continuous measurement mode 1) or 100 Hz (0x06/Continuous measurement mode 2) magnetometer data ODR
+    uint8_t _smplrtDiv = 0x04;              // output data rate 1 kHz / (1 + _smplrtDiv), see setSampleRate()
+    uint8_t _dlpf = 0x03;                   // DLPF_CFG and A_DLPFCFG, 1 (184 Hz) to 6 (5 Hz) bandwidth
     float _aRes, _gRes, _mRes;              // scale resolutions per LSB for the sensors
 
-    float _a[3], _g[3], _m[3];              // variables to hold latest sensor data values
+    float _a[3], _g[3], _m[3];              // latest accel (g), gyro (rad/s) and mag (mG) in the body frame
+    float _aScale[3], _aOffset[3];          // per body axis: scale of the mounted sensor axis and bias, see updateScale()
+    float _gScale[3], _gOffset[3];
+    float _mScale[3], _mOffset[3];
+    int16_t _rawMag[3] = {0, 0, 0};         // latest raw magnetometer values, kept while no new data is ready
+    int16_t _rawAccelGyro[6] = {0, 0, 0, 0, 0, 0}; // latest raw accel and gyro values
+    int16_t _rawTemp = 0;                   // latest raw temperature, from the same burst as _rawAccelGyro
+    uint32_t _magOverflows = 0;             // AK8963 measurements dropped because of magnetic sensor overflow (ST2 HOFL)
 
     float _deltat = 0.0f;                   // integration interval for both filter schemes
     uint32_t _lastUpdate = 0;
     float _q[4] = {1.0f, 0.0f, 0.0f, 0.0f}; // vector to hold quaternion (x, y , z, w) in NED
     float _eInt[3] = {0.0f, 0.0f, 0.0f};    // vector to hold integral error for Mahony method
+    uint32_t _fusionEpoch = 0;              // filter updates so far, see getFusionState()
 
     uint8_t _initialized = 0;
+    bool _fault = false;                    // a transaction failed or the sensor lost its configuration
+    uint32_t _ioErrors = 0;                 // failed transactions
+    uint32_t _recoveries = 0;
+    RegisterShadow _shadow;                 // configuration registers of the MPU9250 at _address
+    bool _wakeOnMotion = false;             // low-power accelerometer-only cycle mode
+    bool _accelFifo = false;                // accelerometer samples stream through the FIFO at 4 kHz
     float _magCalibration[3] = {0, 0, 0}; // (uT, mG = uT * 10)
 
+    // Calibration values are kept in sensor axes (AK8963 axes for the magnetometer), the mount is applied by updateScale()
     // Set the expected magnetic fields depending on your location
     // http://www.ngdc.noaa.gov/geomag-web/#igrfwmm (in nT, mG = nT / 100)
     float _magBias[3] = {
@@ -36,14 +95,59 @@ class MPU9250 {
     float _magScale[3] = {0, 0, 0};
     float _gyroBias[3] = {0, 0, 0};     // (degree/sec)
     float _accelBias[3] = {0, 0, 0};    // (g)
+    float _accelBiasBoot[3] = {0, 0, 0}; // (g) from accelgyrocalMPU9250(), _accelBias adds the temperature correction
+
+    TempBiasTable* _biasTable = NULL;       // temperature compensation, see setBiasTable()
+    int16_t _biasTemp = 0;                  // raw temperature the biases were last looked up at
+    bool _biasValid = false;
+
+#if MPU9250_FUSION_FIXED_POINT
+    fx_t _aFx[3], _gFx[3];                  // latest accel (g) and gyro (rad/s) in the body frame, Q5.26
+    int32_t _mFx[3];                        // latest mag (mG) in the body frame, Q15.16
+    fx_t _qFx[4] = {FX_ONE, 0, 0, 0};       // quaternion in Q5.26
+    fx_t _aScaleFx[3], _aOffsetFx[3];       // g per LSB and (g), rad/s per LSB and (rad/s) per body axis in Q5.26
+    fx_t _gScaleFx[3], _gOffsetFx[3];
+    int32_t _mScaleFx[3], _mOffsetFx[3];    // mG per LSB and mG offset including the soft iron scale, in Q15.16
+    fx_t _gravityFx;                        // m/s2 per g in Q5.26
+#endif
+
+#if DEVICE_I2C_ASYNCH
+    // Double buffered asynchronous sample reads: the transfer fills _asyncData[_asyncFill] while the other buffer
+    // holds the previous sample
+    uint8_t _asyncData[2][22];
+    uint8_t _asyncFill = 0;
+    bool _asyncPending = false;
+    char _asyncRegister = ACCEL_XOUT_H;     // must stay valid during the transfer
+    volatile int _asyncEvent = 0;
+    volatile bool _asyncClaimed = false;    // the completion interrupt or the timeout took over the transfer
+    uint32_t _asyncStart = 0;               // i2c_stats_start() at the start and the completion of the transfer
+    volatile uint32_t _asyncEnd = 0;
+    Semaphore _asyncDone {0};
+#endif
 
     Timer _timer;
 
 public:
-    MPU9250(I2C* i2c, uint8_t busId): _i2c(i2c), _busId(busId) {
+    /*
+     * busId ... identifies the I2C bus `i2c`; sensors with the same busId share a bus
+     * address ... 8-bit device address, (0x68 << 1) for AD0 = 0 and (0x69 << 1) for AD0 = 1
+     */
+    MPU9250(I2C* i2c, uint8_t busId, uint8_t address = MPU9250_ADDRESS): _i2c(i2c), _bus(NULL), _busId(busId), _address(address) {
+        getAres();
+        getGres();
+        getMres();
+        updateScale();
+        _timer.start();
+    }
+
+    /*
+     * Sensor on a shared bus; every transaction is serialised by `bus`, sample reads with I2C_PRIORITY_HIGH
+     */
+    MPU9250(I2CBus* bus, uint8_t address = MPU9250_ADDRESS): _i2c(bus->getI2C()), _bus(bus), _busId(bus->getId()), _address(address) {
         getAres();
         getGres();
         getMres();
+        updateScale();
         _timer.start();
     }
 
@@ -51,15 +155,24 @@ public:
       return _i2c;
     }
 
+    I2CBus* getBus(void) {
+        return _bus;
+    }
+
     void initAll(void) {
         if (_initialized) {
             return;
         }
+        _fault = false;
         resetMPU9250();
         accelgyrocalMPU9250();
         initMPU9250();
         initAK8963();
+        if (_magAuxMaster) {
+            enableMagAuxMaster();
+        }
         magcalMPU9250();
+        updateScale();
         setInitialized();
     }
 
@@ -70,8 +183,66 @@ public:
         _initialized = 1;
     }
 
+    /* True after a failed transaction or when the sensor returned an all-zero sample (reset to sleep mode) */
+    bool hasFault(void) {
+        return _fault;
+    }
+
+    uint32_t getIOErrorCount(void) {
+        return _ioErrors;
+    }
+
+    uint32_t getRecoveryCount(void) {
+        return _recoveries;
+    }
+
+    /*
+     * Fast re-initialization after a fault: clear a stuck bus (shared I2CBus only), reset the MPU9250 and restore the
+     * register configuration of initAll() with the cached calibration. The bias and magnetometer calibration are not
+     * repeated and the fixed settling delays are replaced by polling, so this takes a few milliseconds.
+     * Returns false if the sensor does not answer; call it again later.
+     */
+    bool recover(void) {
+        _recoveries++;
+#if DEVICE_I2C_ASYNCH
+        if (_asyncPending) {
+            finishSampleTransfer();
+        }
+#endif
+        if (_bus) {
+            _bus->recover();
+        }
+        writeByte(_address, PWR_MGMT_1, 0x80); // Reset device
+        // The reset bit clears itself once the device is back; it does not answer in between
+        int i;
+        for (i = 0; i < 100; i++) {
+            wait_ms(1);
+            uint32_t errors = _ioErrors;
+            uint8_t c = readByte(_address, PWR_MGMT_1);
+            if (errors == _ioErrors && !(c & 0x80)) {
+                break;
+            }
+        }
+        if (i == 100) {
+            return false;
+        }
+        _fault = false;
+        _wakeOnMotion = false;
+        initMPU9250(true);
+        initAK8963(true);
+        if (_magAuxMaster) {
+            enableMagAuxMaster();
+        }
+        if (_accelFifo) {
+            enableAccelFifo();
+        }
+        _lastUpdate = _timer.read_us(); // do not integrate the outage
+        uint8_t whoami = whoAmI1();
+        return !_fault && whoami == 0x71;
+    }
+
     uint8_t whoAmI1(void) {
-        uint8_t whoami = readByte(MPU9250_ADDRESS, WHO_AM_I_MPU9250);  // Read WHO_AM_I register for MPU-9250
+        uint8_t whoami = readByte(_address, WHO_AM_I_MPU9250);  // Read WHO_AM_I register for MPU-9250
         return whoami;
     }
 
@@ -84,6 +255,23 @@ public:
         return _busId;
     }
 
+    uint8_t getAddress(void) {
+        return _address;
+    }
+
+    /*
+     * Read the magnetometer through the auxiliary I2C master (SLV0 into EXT_SENS_DATA) instead of the bypass mode.
+     * Required when two MPU9250s share a bus, since every AK8963 answers at the same address in bypass mode.
+     * Call prior to initAll().
+     */
+    void setMagAuxMaster(bool enable) {
+        _magAuxMaster = enable;
+    }
+
+    bool isMagAuxMaster(void) {
+        return _magAuxMaster;
+    }
+
     /*
      * Set magnetometer bias values prior to initAll() call
      * biasX ... +North(-South) (mG)
@@ -94,6 +282,46 @@ public:
         _magBias[0] = biasX;
         _magBias[1] = biasY;
         _magBias[2] = biasZ;
+        updateScale();
+    }
+
+    /*
+     * Read value `index` of an output buffer filled by getAccelGyro(), getMag() or performMadgwickQuaternionUpdate()
+     */
+    static float outputToFloat(const uint8_t* out, int index) {
+#if MPU9250_FUSION_FIXED_POINT
+        return fx_to_float(((const int32_t*) out)[index], FX_OUT_FRAC_BITS);
+#else
+        return ((const float*) out)[index];
+#endif
+    }
+
+    /*
+     * Recompute the per-axis scales and offsets of the sample conversion from the resolutions and calibration values.
+     * Scale and offset of body axis i belong to sensor axis Mount::axis(i), with the mount sign folded in, so the
+     * conversion is one multiply and subtract per axis for every mount. Called after calibration.
+     */
+    void updateScale(void) {
+        for (int i = 0; i < 3; i++) {
+            int a = Mount::axis(i), m = MagMount::axis(i);
+            _aScale[i] = Mount::sign(i) * _aRes;
+            _aOffset[i] = Mount::sign(i) * _accelBias[a];
+            _gScale[i] = Mount::sign(i) * DEG_TO_RAD * _gRes;
+            _gOffset[i] = Mount::sign(i) * DEG_TO_RAD * _gyroBias[a];
+            _mScale[i] = MagMount::sign(i) * _mRes * _magCalibration[m] * _magScale[m];
+            _mOffset[i] = MagMount::sign(i) * _magBias[m] * _magScale[m];
+#if MPU9250_FUSION_FIXED_POINT
+            _aScaleFx[i] = fx_from_float(_aScale[i]);
+            _aOffsetFx[i] = fx_from_float(_aOffset[i]);
+            _gScaleFx[i] = fx_from_float(_gScale[i]);
+            _gOffsetFx[i] = fx_from_float(_gOffset[i]);
+            _mScaleFx[i] = fx_from_float(_mScale[i], FX_OUT_FRAC_BITS);
+            _mOffsetFx[i] = fx_from_float(_mOffset[i], FX_OUT_FRAC_BITS);
+#endif
+        }
+#if MPU9250_FUSION_FIXED_POINT
+        _gravityFx = fx_from_float(G);
+#endif
     }
 
     //===================================================================================================================
@@ -101,32 +329,208 @@ public:
     //===================================================================================================================
 
     void writeByte(uint8_t address, uint8_t subAddress, uint8_t data) {
+        uint32_t start = i2c_stats_start();
+        I2CBusLock lock(_bus, I2C_PRIORITY_LOW);
         char data_write[2];
         data_write[0] = subAddress;
         data_write[1] = data;
-        _i2c->write(address, data_write, 2, 0);
+        int status = _i2c->write(address, data_write, 2, 0);
+        i2c_stats_record(address, subAddress, I2C_STATS_WRITE, 1, start, status);
+        checkStatus(status);
+        shadowWrite(address, subAddress, 1, &data, status);
+    }
+
+    /* Burst write of up to MPU9250_CONFIG_MAX registers from subAddress on (register address auto-increment) */
+    void writeBytes(uint8_t address, uint8_t subAddress, uint8_t count, const uint8_t * data) {
+        uint32_t start = i2c_stats_start();
+        I2CBusLock lock(_bus, I2C_PRIORITY_LOW);
+        char data_write[1 + MPU9250_CONFIG_MAX];
+        data_write[0] = subAddress;
+        memcpy(&data_write[1], data, count);
+        int status = _i2c->write(address, data_write, 1 + count, 0);
+        i2c_stats_record(address, subAddress, I2C_STATS_WRITE, count, start, status);
+        checkStatus(status);
+        shadowWrite(address, subAddress, count, data, status);
     }
 
-    char readByte(uint8_t address, uint8_t subAddress) {
+    char readByte(uint8_t address, uint8_t subAddress, I2CBusPriority priority = I2C_PRIORITY_LOW) {
+        uint32_t start = i2c_stats_start();
+        I2CBusLock lock(_bus, priority);
         char data[1]; // `data` will store the register data
         char data_write[1];
         data_write[0] = subAddress;
-        _i2c->write(address, data_write, 1, 1); // no stop
-        _i2c->read(address, data, 1, 0);
+        int status = _i2c->write(address, data_write, 1, 1); // no stop
+        status |= _i2c->read(address, data, 1, 0);
+        i2c_stats_record(address, subAddress, I2C_STATS_READ, 1, start, status);
+        checkStatus(status);
+        if (address == _address && status == 0) {
+            _shadow.store(subAddress, data[0]);
+        }
         return data[0];
     }
 
-    void readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest) {
-        char data[14];
+    void readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest, I2CBusPriority priority = I2C_PRIORITY_LOW) {
+        uint32_t start = i2c_stats_start();
+        I2CBusLock lock(_bus, priority);
         char data_write[1];
         data_write[0] = subAddress;
-        _i2c->write(address, data_write, 1, 1); // no stop
-        _i2c->read(address, data, count, 0);
-        for(int ii = 0; ii < count; ii++) {
-            dest[ii] = data[ii];
+        int status = _i2c->write(address, data_write, 1, 1); // no stop
+        status |= _i2c->read(address, (char*) dest, count, 0);
+        i2c_stats_record(address, subAddress, I2C_STATS_READ, count, start, status);
+        checkStatus(status);
+    }
+
+    /* Non-zero I2C return codes (NACK, arbitration loss or timeout) mark the sensor as faulty until recover() */
+    void checkStatus(int status) {
+        if (status != 0) {
+            _ioErrors++;
+            _fault = true;
         }
     }
 
+    // Keep the shadow in step with the device: a failed write leaves unknown register contents, a reset restores defaults
+    void shadowWrite(uint8_t address, uint8_t subAddress, uint8_t count, const uint8_t* data, int status) {
+        if (address != _address) {
+            return;
+        }
+        if (status != 0) {
+            _shadow.invalidate();
+            return;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            if (subAddress + i == PWR_MGMT_1 && (data[i] & 0x80)) {
+                _shadow.invalidate();
+            } else {
+                _shadow.store(subAddress + i, data[i]);
+            }
+        }
+    }
+
+    /*
+     * Bring the registers of `settings` to their configured bits with as few transactions as possible:
+     * - partially configured registers (mask != 0xFF) unknown to the shadow are read back, adjacent ones in one burst
+     * - registers that already hold the configured value are not written
+     * - the others are written in auto-increment bursts; up to two unchanged registers between changed ones are
+     *   rewritten with their shadow value rather than starting a new transaction
+     * `settings` must be in ascending register order, contain cached registers only (RegisterShadow::isCached())
+     * and have at most MPU9250_CONFIG_MAX entries.
+     */
+    void applyConfig(const RegisterSetting* settings, uint8_t count) {
+        uint8_t target[MPU9250_CONFIG_MAX];
+        bool dirty[MPU9250_CONFIG_MAX];
+        uint8_t i, j, k;
+
+        if (count > MPU9250_CONFIG_MAX) {
+            return;
+        }
+        for (i = 0; i < count; i = j + 1) {
+            // settings[i..j] are adjacent registers; read back from the first to the last unknown one
+            uint8_t lo = count, hi = 0;
+            for (j = i; ; j++) {
+                if (settings[j].mask != 0xFF && !_shadow.isValid(settings[j].reg)) {
+                    lo = lo < j ? lo : j;
+                    hi = j;
+                }
+                if (j + 1 == count || settings[j + 1].reg != settings[j].reg + 1) {
+                    break;
+                }
+            }
+            if (lo <= hi) {
+                uint8_t data[MPU9250_CONFIG_MAX];
+                uint32_t errors = _ioErrors;
+                readBytes(_address, settings[lo].reg, hi - lo + 1, data);
+                if (errors != _ioErrors) {
+                    return;
+                }
+                for (k = lo; k <= hi; k++) {
+                    _shadow.store(settings[k].reg, data[k - lo]);
+                }
+            }
+        }
+
+        for (i = 0; i < count; i++) {
+            uint8_t current = _shadow.get(settings[i].reg);
+            target[i] = (current & ~settings[i].mask) | (settings[i].value & settings[i].mask);
+            dirty[i] = !_shadow.isValid(settings[i].reg) || current != target[i];
+        }
+
+        for (i = 0; i < count; i = j + 1) {
+            j = i;
+            if (!dirty[i]) {
+                continue;
+            }
+            // j is the last changed register of the burst
+            for (k = i + 1; k < count && settings[k].reg == settings[k - 1].reg + 1 && k - j <= 3; k++) {
+                if (dirty[k]) {
+                    j = k;
+                }
+            }
+            writeBytes(_address, settings[i].reg, j - i + 1, &target[i]);
+        }
+    }
+
+    /*
+     * Runtime full scale changes, one register write each once the shadow is valid.
+     * GFS_2000DPS is not supported with MPU9250_FUSION_FIXED_POINT=1.
+     */
+    void setAccelScale(uint8_t scale) {
+        _Ascale = scale;
+        getAres();
+        updateScale();
+        if (_initialized) {
+            const RegisterSetting setting = {ACCEL_CONFIG, 0x18, (uint8_t) (_Ascale << 3)};
+            applyConfig(&setting, 1);
+        }
+    }
+
+    void setGyroScale(uint8_t scale) {
+        _Gscale = scale;
+        getGres();
+        updateScale();
+        if (_initialized) {
+            const RegisterSetting setting = {GYRO_CONFIG, 0x18, (uint8_t) (_Gscale << 3)};
+            applyConfig(&setting, 1);
+        }
+    }
+
+    /*
+     * Runtime output data rate: 1 kHz / (1 + smplrtDiv) with the gyro and accel low-pass filter `dlpf` (1 to 6, the
+     * same bandwidth for both, see initMPU9250()) and the AK8963 continuous mode `magMode` (0x02 8 Hz, 0x06 100 Hz).
+     * One burst of at most three registers once the shadow is valid, plus the mag mode change if it differs. recover()
+     * keeps the rate. The fusion integrates over the measured time between updates, so the filter step follows the new
+     * rate from the next update on and the update across the switch covers the switch itself.
+     */
+    void setSampleRate(uint8_t smplrtDiv, uint8_t dlpf, uint8_t magMode) {
+        bool magChanged = magMode != _Mmode;
+        _smplrtDiv = smplrtDiv;
+        _dlpf = dlpf & 0x07;
+        _Mmode = magMode;
+        if (!_initialized || _wakeOnMotion) {
+            return; // applied by initAll() or disableWakeOnMotion()
+        }
+        const RegisterSetting config[] = {
+            {SMPLRT_DIV,    0xFF, _smplrtDiv},
+            {CONFIG,        0x07, _dlpf},
+            {ACCEL_CONFIG2, 0x0F, (uint8_t) (_accelFifo ? 0x08 : _dlpf)},
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
+        if (magChanged) {
+            // Mode changes go through power-down
+            if (_magAuxMaster) {
+                writeMagAux(AK8963_CNTL, 0x00);
+                wait_us(100);
+                writeMagAux(AK8963_CNTL, _Mscale << 4 | _Mmode);
+            } else {
+                initAK8963(true);
+            }
+        }
+    }
+
+    /* Output data rate (Hz) set by initMPU9250() or setSampleRate() */
+    float getSampleRate(void) {
+        return 1000.0f / (1 + _smplrtDiv);
+    }
+
     void getMres() {
         switch (_Mscale)
         {
@@ -142,7 +546,7 @@ public:
     }
 
     void getGres() {
-        switch (_Mscale)
+        switch (_Gscale)
         {
             // Possible gyro scales (and their register bit settings) are:
             // 250 DPS (00), 500 DPS (01), 1000 DPS (10), and 2000 DPS    (11).
@@ -184,23 +588,39 @@ public:
     }
 
     void transformAccelGyro(int16_t* src, uint8_t* out) {
-        int8_t base = 0;
-        int8_t i;
-        float f;
+        if (_biasTable && (!_biasValid || abs(_rawTemp - _biasTemp) > TEMP_BIAS_UPDATE_LSB)) {
+            updateTempBias();
+        }
+        // Body axis i is sensor axis Mount::axis(i), a constant after unrolling; the sign is part of the scale
+#if MPU9250_FUSION_FIXED_POINT
+        int32_t* out_data = (int32_t *) out;
+        for (int i = 0; i < 3; i++) {
+            _aFx[i] = src[Mount::axis(i)] * _aScaleFx[i] - _aOffsetFx[i];
+            // g to m/s*s, straight into Q15.16 since 16 g is beyond the Q5.26 range in m/s*s
+            out_data[i] = fx_mul_to_out(_aFx[i], _gravityFx);
+            _gFx[i] = src[3 + Mount::axis(i)] * _gScaleFx[i] - _gOffsetFx[i];
+            out_data[3 + i] = fx_to_out(_gFx[i]);
+        }
+#else
         float* out_data = (float *) out;
-
-        for (i = 0; i < 3; i++) {
-            f = (float) src[i] * _aRes - _accelBias[i];
-            _a[i] = f;
+        convertAccelGyro(src, _a, _g);
+        for (int i = 0; i < 3; i++) {
             // g to m/s*s
-            out_data[base + i] = G * f;
+            out_data[i] = G * _a[i];
+            out_data[3 + i] = _g[i];
         }
-        base += 3;
-        for (i = 0; i < 3; i++) {
-            // Degree to Radian
-            f = DEG_TO_RAD * ((float) src[base + i] * _gRes - _gyroBias[i]);
-            _g[i] = f;
-            out_data[base + i] = f;
+#endif
+    }
+
+    /*
+     * Float conversion of raw accel/gyro values to accel (g) and gyro (rad/s) in the body frame, as used by
+     * transformAccelGyro() in the float build. Kept in the fixed-point build as the reference of its Q-format path.
+     */
+    void convertAccelGyro(const int16_t* src, float* accel, float* gyro) {
+        for (int i = 0; i < 3; i++) {
+            accel[i] = (float) src[Mount::axis(i)] * _aScale[i] - _aOffset[i];
+            // rad/s, DEG_TO_RAD is part of the scale
+            gyro[i] = (float) src[3 + Mount::axis(i)] * _gScale[i] - _gOffset[i];
         }
     }
 
@@ -214,33 +634,57 @@ public:
     /* uint8_t out[4 * 3] */
     void getMag(uint8_t *out) {
         int16_t data[3];
+        getRawMag(data);
+        transformMag(data, out);
+    }
+
+    /* Raw mag values as used by getMag() */
+    void getRawMag(int16_t* dest) {
+        // Otherwise use the latest value taken by getAccelGyroAsync() or from the accel/gyro burst; the bus may be busy
+        if (!isAsyncStreaming() && !_magAuxMaster) {
+            readMagData(_rawMag); // keeps the previous value while no new data is ready
+        }
+        dest[0] = _rawMag[0];
+        dest[1] = _rawMag[1];
+        dest[2] = _rawMag[2];
+    }
+
+    /* uint8_t out[4 * 3] */
+    void transformMag(const int16_t* src, uint8_t* out) {
         int8_t i;
-        float f;
+#if MPU9250_FUSION_FIXED_POINT
+        for (i = 0; i < 3; i++) {
+            // Saturate instead of wrapping beyond +-32768 mG
+            int64_t v = (int64_t) src[MagMount::axis(i)] * _mScaleFx[i] - _mOffsetFx[i];
+            _mFx[i] = v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t) v;
+            ((int32_t *) out)[i] = _mFx[i];
+        }
+#else
         float* out_data = (float *) out;
-        readMagData(data);
+        convertMag(src, _m);
         for (i = 0; i < 3; i++) {
-            // micro Tesla to milliGauss (_mRes)
-            f = (float) data[i] * _mRes * _magCalibration[i] - _magBias[i];
-            f *= _magScale[i];
-            _m[i] = f;
-            out_data[i] = f;
+            out_data[i] = _m[i];
+        }
+#endif
+    }
+
+    /* Float conversion of raw mag values to mG in the body frame, see convertAccelGyro() */
+    void convertMag(const int16_t* src, float* mag) {
+        for (int i = 0; i < 3; i++) {
+            // micro Tesla to milliGauss (_mRes), factory sensitivity and soft iron scale in one factor
+            mag[i] = (float) src[MagMount::axis(i)] * _mScale[i] - _mOffset[i];
         }
     }
 
     void readAccelGyroData(int16_t * destination) {
-        uint8_t rawData[14];    // x/y/z accel register data stored here
-        readBytes(MPU9250_ADDRESS, ACCEL_XOUT_H, 14, &rawData[0]);    // Read the six raw data registers into data array
-        destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;    // Turn the MSB and LSB into a signed 16-bit value
-        destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
-        destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
-        destination[3] = (int16_t)(((int16_t)rawData[8] << 8) | rawData[9]) ;    // Turn the MSB and LSB into a signed 16-bit value
-        destination[4] = (int16_t)(((int16_t)rawData[10] << 8) | rawData[11]) ;
-        destination[5] = (int16_t)(((int16_t)rawData[12] << 8) | rawData[13]) ;
+        uint8_t rawData[22];    // x/y/z accel register data stored here
+        readBytes(_address, ACCEL_XOUT_H, _magAuxMaster ? 22 : 14, &rawData[0], I2C_PRIORITY_HIGH);    // Read the six raw data registers into data array
+        decodeAccelGyro(rawData, destination);    // Turn the MSB and LSB into signed 16-bit values
     }
 
     void readAccelData(int16_t * destination) {
         uint8_t rawData[6];    // x/y/z accel register data stored here
-        readBytes(MPU9250_ADDRESS, ACCEL_XOUT_H, 6, &rawData[0]);    // Read the six raw data registers into data array
+        readBytes(_address, ACCEL_XOUT_H, 6, &rawData[0], I2C_PRIORITY_HIGH);    // Read the six raw data registers into data array
         destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;    // Turn the MSB and LSB into a signed 16-bit value
         destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
         destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
@@ -248,38 +692,298 @@ public:
 
     void readGyroData(int16_t * destination) {
         uint8_t rawData[6];    // x/y/z gyro register data stored here
-        readBytes(MPU9250_ADDRESS, GYRO_XOUT_H, 6, &rawData[0]);    // Read the six raw data registers sequentially into data array
+        readBytes(_address, GYRO_XOUT_H, 6, &rawData[0], I2C_PRIORITY_HIGH);    // Read the six raw data registers sequentially into data array
         destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;    // Turn the MSB and LSB into a signed 16-bit value
         destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
         destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
     }
 
     void readMagData(int16_t * destination) {
-        uint8_t rawData[7];    // x/y/z gyro register data, ST2 register stored here, must read ST2 at end of data acquisition
-        if(((_Mmode & 0x01) == 0) || (readByte(AK8963_ADDRESS, AK8963_ST1) & 0x01)) { // wait for magnetometer data ready bit to be set
-            readBytes(AK8963_ADDRESS, AK8963_XOUT_L, 7, &rawData[0]);    // Read the six raw data and ST2 registers sequentially into data array
+        uint8_t rawData[8];    // x/y/z gyro register data, ST2 register stored here, must read ST2 at end of data acquisition
+        if (_magAuxMaster) {
+            readBytes(_address, EXT_SENS_DATA_00, 8, &rawData[0], I2C_PRIORITY_HIGH);    // ST1, data and ST2 copied by SLV0
+            parseMagData(rawData, destination);
+            return;
+        }
+        if(((_Mmode & 0x01) == 0) || (readByte(AK8963_ADDRESS, AK8963_ST1, I2C_PRIORITY_HIGH) & 0x01)) { // wait for magnetometer data ready bit to be set
+            readBytes(AK8963_ADDRESS, AK8963_XOUT_L, 7, &rawData[0], I2C_PRIORITY_HIGH);    // Read the six raw data and ST2 registers sequentially into data array
             uint8_t c = rawData[6]; // End data read by reading ST2 register
             if(!(c & 0x08)) { // Check if magnetic sensor overflow set, if not then report data
                 destination[0] = (int16_t)(((int16_t)rawData[1] << 8) | rawData[0]);    // Turn the MSB and LSB into a signed 16-bit value
                 destination[1] = (int16_t)(((int16_t)rawData[3] << 8) | rawData[2]) ;    // Data stored as little Endian
                 destination[2] = (int16_t)(((int16_t)rawData[5] << 8) | rawData[4]) ;
+            } else {
+                _magOverflows++;
             }
         }
     }
 
+    /* Mag values from ST1, six data bytes and ST2 as copied to EXT_SENS_DATA by the auxiliary I2C master */
+    void parseMagData(const uint8_t* rawData, int16_t * destination) {
+        if((rawData[0] & 0x01) && !(rawData[7] & 0x08)) { // data ready and no magnetic sensor overflow
+            destination[0] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[1]);
+            destination[1] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[3]);
+            destination[2] = (int16_t)(((int16_t)rawData[6] << 8) | rawData[5]);
+        } else if (rawData[0] & 0x01) {
+            _magOverflows++;
+        }
+    }
+
+    /* True once per new accel/gyro sample: RAW_DATA_RDY_INT of INT_STATUS, which the read clears */
+    bool isDataReady(void) {
+        return readByte(_address, INT_STATUS, I2C_PRIORITY_HIGH) & 0x01;
+    }
+
+    /* Raw accel, temperature and gyro from one burst read plus the latest raw mag values */
+    void readRawFrame(SampleFrame* frame) {
+        uint8_t rawData[22];    // accel, temperature, gyro and (aux master mode) EXT_SENS_DATA_00..07 stored here
+        readBytes(_address, ACCEL_XOUT_H, _magAuxMaster ? 22 : 14, &rawData[0], I2C_PRIORITY_HIGH);
+        for (int i = 0; i < 7; i++) {
+            frame->values[FRAME_ACCEL_X + i] = (int16_t)(((int16_t)rawData[2 * i] << 8) | rawData[2 * i + 1]);
+        }
+        for (int i = 0; i < 3; i++) {
+            _rawAccelGyro[i] = frame->values[FRAME_ACCEL_X + i];
+            _rawAccelGyro[3 + i] = frame->values[FRAME_GYRO_X + i];
+        }
+        _rawTemp = frame->values[FRAME_TEMP];
+        if (_magAuxMaster) {
+            parseMagData(&rawData[14], _rawMag);
+        } else {
+            readMagData(_rawMag);
+        }
+        frame->values[FRAME_MAG_X] = _rawMag[0];
+        frame->values[FRAME_MAG_Y] = _rawMag[1];
+        frame->values[FRAME_MAG_Z] = _rawMag[2];
+    }
+
+#if DEVICE_I2C_ASYNCH
+    // The first of the completion interrupt and the timeout of finishSampleTransfer() owns the end of the transfer:
+    // it releases the bus and, for the interrupt, _asyncDone. Returns false if the other one came first.
+    bool claimSampleTransfer(void) {
+        core_util_critical_section_enter();
+        bool claimed = !_asyncClaimed;
+        _asyncClaimed = true;
+        core_util_critical_section_exit();
+        return claimed;
+    }
+
+    // Completion callback of I2C::transfer(), called from the I2C interrupt
+    void onAsyncTransfer(int event) {
+        if (!claimSampleTransfer()) {
+            return; // aborted after a timeout
+        }
+        _asyncEnd = i2c_stats_start();
+        _asyncEvent = event;
+        if (_bus) {
+            _bus->unlock();
+        }
+        _asyncDone.release();
+    }
+
+    /*
+     * Start a non-blocking burst read of accel, temperature, gyro (and mag in aux master mode) into the free buffer.
+     * The bus is held until the transfer completes. Returns false if a transfer is already pending or cannot start.
+     */
+    bool startSampleTransfer(void) {
+        if (_asyncPending) {
+            return false;
+        }
+        _asyncStart = i2c_stats_start();
+        if (_bus) {
+            _bus->lock(I2C_PRIORITY_HIGH);
+        }
+        _asyncEvent = 0;
+        _asyncClaimed = false;
+        if (_i2c->transfer(_address, &_asyncRegister, 1, (char*) _asyncData[_asyncFill], _magAuxMaster ? 22 : 14,
+                callback(this, &MPU9250::onAsyncTransfer), I2C_EVENT_ALL, false) != 0) {
+            if (_bus) {
+                _bus->unlock();
+            }
+            checkStatus(-1);
+            return false;
+        }
+        _asyncPending = true;
+        return true;
+    }
+
+    /*
+     * Wait for the transfer started by startSampleTransfer() and swap the buffers.
+     * Returns the raw burst, valid until the next call, or NULL when no transfer was pending or it failed.
+     */
+    const uint8_t* finishSampleTransfer(void) {
+        if (!_asyncPending) {
+            return NULL;
+        }
+        _asyncPending = false;
+        if (_asyncDone.wait(MPU9250_ASYNC_TIMEOUT_MS) <= 0) {
+            if (claimSampleTransfer()) {
+                // No completion interrupt, e.g. SCL held low by a slave
+                _i2c->abort_transfer();
+                if (_bus) {
+                    _bus->unlock();
+                }
+                _asyncEvent = I2C_EVENT_ERROR;
+                _asyncEnd = i2c_stats_start();
+            }
+            // Take the token of a completion that came after the timeout, so that the next transfer waits for its own
+            while (_asyncDone.wait(0) > 0);
+        }
+        bool failed = !(_asyncEvent & I2C_EVENT_TRANSFER_COMPLETE) ||
+            (_asyncEvent & (I2C_EVENT_ERROR | I2C_EVENT_ERROR_NO_SLAVE | I2C_EVENT_TRANSFER_EARLY_NACK));
+        i2c_stats_record_us(_address, _asyncRegister, I2C_STATS_READ, _magAuxMaster ? 22 : 14, _asyncEnd - _asyncStart, failed);
+        checkStatus(failed);
+        if (failed) {
+            return NULL;
+        }
+        const uint8_t* raw = _asyncData[_asyncFill];
+        _asyncFill ^= 1;
+        return raw;
+    }
+
+    /*
+     * Pipelined getAccelGyro(): completes the transfer started by the previous call, starts the next one and converts
+     * the completed sample while the next transfer is running. The returned sample is therefore one call old.
+     * In bypass mode the magnetometer is read synchronously in between and getMag() returns that value.
+     * Returns false when no sample is available yet (first call) or the transfer failed.
+     */
+    bool getAccelGyroAsync(uint8_t *out) {
+        const uint8_t* raw = finishSampleTransfer();
+        if (raw && !_magAuxMaster) {
+            readMagData(_rawMag);
+        }
+        startSampleTransfer();
+        if (!raw) {
+            return false;
+        }
+        int16_t data[6];
+        decodeAccelGyro(raw, data);
+        transformAccelGyro(data, out);
+        return true;
+    }
+#endif
+
+    /* Accel and gyro from a 14 (or 22, aux master mode) byte burst starting at ACCEL_XOUT_H */
+    void decodeAccelGyro(const uint8_t* rawData, int16_t * destination) {
+        destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;
+        destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
+        destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
+        destination[3] = (int16_t)(((int16_t)rawData[8] << 8) | rawData[9]) ;
+        destination[4] = (int16_t)(((int16_t)rawData[10] << 8) | rawData[11]) ;
+        destination[5] = (int16_t)(((int16_t)rawData[12] << 8) | rawData[13]) ;
+        memcpy(_rawAccelGyro, destination, sizeof(_rawAccelGyro));
+        _rawTemp = (int16_t)(((int16_t)rawData[6] << 8) | rawData[7]);
+        if (_magAuxMaster) {
+            parseMagData(&rawData[14], _rawMag);
+        }
+        // Gravity never reads zero on all axes; a sensor that has been reset is asleep and returns zeros
+        if (!(destination[0] | destination[1] | destination[2] | destination[3] | destination[4] | destination[5])) {
+            _fault = true;
+        }
+    }
+
+    /* Raw values of the last sample: accel x/y/z, gyro x/y/z and mag x/y/z, without bus access */
+    void getLastRaw(int16_t* dest) {
+        memcpy(dest, _rawAccelGyro, sizeof(_rawAccelGyro));
+        memcpy(&dest[6], _rawMag, sizeof(_rawMag));
+    }
+
+    /* Raw temperature of the last accel/gyro sample, see rawToTemperature() */
+    int16_t getLastRawTemp(void) {
+        return _rawTemp;
+    }
+
+    static float rawToTemperature(int16_t raw) {
+        return (float) raw / TEMP_SENSITIVITY + TEMP_OFFSET;
+    }
+
+    /*
+     * Last sample as seen by the bias learner (BiasLearner::update()): gyro (dps) without bias compensation,
+     * accel (g) with the boot-time bias removed only, and the die temperature (degC)
+     */
+    void getBiasSample(float* gyro, float* accel, float* tempC) {
+        for (int i = 0; i < 3; i++) {
+            accel[i] = (float) _rawAccelGyro[i] * _aRes - _accelBiasBoot[i];
+            gyro[i] = (float) _rawAccelGyro[3 + i] * _gRes;
+        }
+        *tempC = rawToTemperature(_rawTemp);
+    }
+
+    /*
+     * Compensate the gyro and accel biases over temperature with `table`, NULL to use the boot-time biases only.
+     * The biases are looked up again whenever the temperature changed by more than TEMP_BIAS_UPDATE_LSB.
+     */
+    void setBiasTable(TempBiasTable* table) {
+        _biasTable = table;
+        _biasValid = false;
+        if (!table) {
+            memcpy(_accelBias, _accelBiasBoot, sizeof(_accelBias));
+            updateScale();
+        }
+    }
+
+    /* Look up the table at the current temperature; keeps the current biases while the table is empty */
+    void updateTempBias(void) {
+        float gyro[3], accel[3];
+        _biasTemp = _rawTemp;
+        _biasValid = true;
+        if (!_biasTable->lookup(rawToTemperature(_rawTemp), gyro, accel)) {
+            return;
+        }
+        for (int i = 0; i < 3; i++) {
+            _gyroBias[i] = gyro[i];
+            _accelBias[i] = _accelBiasBoot[i] + accel[i];
+        }
+        updateScale();
+    }
+
+    uint32_t getMagOverflowCount(void) {
+        return _magOverflows;
+    }
+
+    uint8_t getAccelScale(void) {
+        return _Ascale;
+    }
+
+    uint8_t getGyroScale(void) {
+        return _Gscale;
+    }
+
+    /* g per LSB of the raw accelerometer values */
+    float getAccelResolution(void) {
+        return _aRes;
+    }
+
+    bool isAsyncStreaming(void) {
+#if DEVICE_I2C_ASYNCH
+        return _asyncPending;
+#else
+        return false;
+#endif
+    }
+
     int16_t readTempData() {
         uint8_t rawData[2];    // x/y/z gyro register data stored here
-        readBytes(MPU9250_ADDRESS, TEMP_OUT_H, 2, &rawData[0]);    // Read the two raw data registers sequentially into data array
+        readBytes(_address, TEMP_OUT_H, 2, &rawData[0], I2C_PRIORITY_HIGH);    // Read the two raw data registers sequentially into data array
         return (int16_t)(((int16_t)rawData[0]) << 8 | rawData[1]) ;    // Turn the MSB and LSB into a 16-bit value
     }
 
     void resetMPU9250() {
         // reset device
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
+        writeByte(_address, PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
         wait(0.1);
     }
 
-    void initAK8963(void) {
+    /*
+     * fast ... keep the cached factory calibration (recover())
+     */
+    void initAK8963(bool fast = false) {
+        if (fast) {
+            writeByte(AK8963_ADDRESS, AK8963_CNTL, 0x00); // Power down magnetometer
+            wait_us(100); // mode transition time
+            writeByte(AK8963_ADDRESS, AK8963_CNTL, _Mscale << 4 | _Mmode);
+            wait_us(100);
+            return;
+        }
         float * destination = _magCalibration;
         // First extract the factory calibration for each magnetometer axis
         uint8_t rawData[3];    // x/y/z gyro calibration data stored here
@@ -300,43 +1004,189 @@ public:
         wait(0.01);
     }
 
-    void initMPU9250() {
+    /*
+     * Write an AK8963 register through SLV4 of the auxiliary I2C master (aux master mode, the AK8963 is not on the host
+     * bus). Returns false if the transfer did not complete.
+     */
+    bool writeMagAux(uint8_t subAddress, uint8_t data) {
+        writeByte(_address, I2C_SLV4_ADDR, (AK8963_ADDRESS) >> 1); // Write to the 7-bit AK8963 address
+        writeByte(_address, I2C_SLV4_REG, subAddress);
+        writeByte(_address, I2C_SLV4_DO, data);
+        writeByte(_address, I2C_SLV4_CTRL, 0x80);   // Start a single transfer
+        for (int i = 0; i < 10; i++) {
+            if (readByte(_address, I2C_MST_STATUS) & 0x40) { // I2C_SLV4_DONE
+                return true;
+            }
+            wait_us(100);
+        }
+        return false;
+    }
+
+    /*
+     * Low-power wake-on-motion mode: the gyro and the magnetometer are powered down and the accelerometer alone wakes up
+     * at `odr` (LPAccelODR). The WOM interrupt (INT pin, latched until INT_STATUS is read) is raised when an axis
+     * changes by more than thresholdMg (4 mg resolution, up to 1020 mg) against the previous low-power sample.
+     * Leave the mode with disableWakeOnMotion() before reading samples again.
+     */
+    void enableWakeOnMotion(uint16_t thresholdMg, uint8_t odr) {
+        if (_magAuxMaster) {
+            const RegisterSetting stop = {I2C_SLV0_CTRL, 0xFF, 0x00};   // Stop polling the AK8963
+            applyConfig(&stop, 1);
+            writeMagAux(AK8963_CNTL, 0x00);
+        } else {
+            writeByte(AK8963_ADDRESS, AK8963_CNTL, 0x00);                // Power down magnetometer
+        }
+        writeByte(_address, PWR_MGMT_1, 0x00);  // No cycle, sleep or standby while configuring
+        uint16_t threshold = thresholdMg / 4;
+        const RegisterSetting config[] = {
+            {ACCEL_CONFIG2,   0x0F, 0x09},  // accel_fchoice_b = 1, A_DLPFCFG = 1 (1.13 kHz bandwidth)
+            {LP_ACCEL_ODR,    0x0F, odr},
+            {WOM_THR,         0xFF, (uint8_t) (threshold > 0xFF ? 0xFF : threshold)},
+            {INT_ENABLE,      0xFF, 0x40},  // Wake on motion interrupt only
+            {MOT_DETECT_CTRL, 0xC0, 0xC0},  // ACCEL_INTEL_EN, ACCEL_INTEL_MODE: compare against the previous sample
+            {PWR_MGMT_2,      0x3F, 0x07},  // Gyro axes off, accelerometer axes on
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
+        writeByte(_address, PWR_MGMT_1, 0x20);  // CYCLE: sample the accelerometer at LP_ACCEL_ODR
+        readByte(_address, INT_STATUS);         // Clear a latched interrupt
+        _wakeOnMotion = true;
+    }
+
+    /*
+     * Back to full-rate 9-axis acquisition with the configuration of initAll()
+     */
+    void disableWakeOnMotion(void) {
+        writeByte(_address, PWR_MGMT_1, 0x01);  // Leave cycle mode, PLL clock source
+        const RegisterSetting config[] = {
+            {SMPLRT_DIV,      0xFF, _smplrtDiv},    // may have changed in low power, see setSampleRate()
+            {CONFIG,          0x07, _dlpf},
+            {ACCEL_CONFIG2,   0x0F, (uint8_t) (_accelFifo ? 0x08 : _dlpf)},
+            {INT_ENABLE,      0xFF, 0x01},  // Data ready interrupt
+            {MOT_DETECT_CTRL, 0xC0, 0x00},
+            {PWR_MGMT_2,      0x3F, 0x00},  // All axes on
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
+        if (_magAuxMaster) {
+            writeMagAux(AK8963_CNTL, _Mscale << 4 | _Mmode);
+            const RegisterSetting start = {I2C_SLV0_CTRL, 0xFF, 0x88};
+            applyConfig(&start, 1);
+        } else {
+            writeByte(AK8963_ADDRESS, AK8963_CNTL, _Mscale << 4 | _Mmode);
+        }
+        readByte(_address, INT_STATUS);
+        wait_ms(35);                            // Gyro start-up time
+        _wakeOnMotion = false;
+        _lastUpdate = _timer.read_us();         // do not integrate the time spent in low power
+    }
+
+    bool isWakeOnMotion(void) {
+        return _wakeOnMotion;
+    }
+
+    /*
+     * Stream the accelerometer through the FIFO at its 4 kHz output rate (accel_fchoice_b = 1, 1.13 kHz bandwidth)
+     * next to the regular sample reads, for vibration analysis. The data registers then hold the same unfiltered
+     * accelerometer output. Drain the FIFO with readAccelFifo() at least every 20 ms; it holds 85 samples.
+     */
+    void enableAccelFifo(void) {
+        const RegisterSetting config[] = {
+            {ACCEL_CONFIG2, 0x0F, 0x08},    // accel_fchoice_b = 1: DLPF bypassed, 4 kHz
+            {FIFO_EN,       0xFF, 0x08},    // ACCEL
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
+        writeByte(_address, USER_CTRL, (_magAuxMaster ? 0x20 : 0x00) | 0x44);  // FIFO_EN, FIFO_RST
+        _accelFifo = true;
+    }
+
+    void disableAccelFifo(void) {
+        const RegisterSetting config[] = {
+            {ACCEL_CONFIG2, 0x0F, _dlpf},
+            {FIFO_EN,       0xFF, 0x00},
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
+        writeByte(_address, USER_CTRL, _magAuxMaster ? 0x20 : 0x00);
+        _accelFifo = false;
+    }
+
+    /*
+     * Read up to `maxSamples` (at most MPU9250_FIFO_BURST) raw accel x/y/z samples from the FIFO into `dest`.
+     * Returns the number of samples, or -1 if the FIFO overflowed; it is then reset and the stream has a gap.
+     */
+    int readAccelFifo(int16_t* dest, int maxSamples) {
+        uint8_t data[6 * MPU9250_FIFO_BURST];
+        readBytes(_address, FIFO_COUNTH, 2, data, I2C_PRIORITY_HIGH);
+        int count = (data[0] & 0x1F) << 8 | data[1];
+        if (count >= MPU9250_FIFO_SIZE || count % 6) {
+            // Full FIFO overwrites the oldest bytes, which breaks the sample alignment
+            writeByte(_address, USER_CTRL, (_magAuxMaster ? 0x20 : 0x00) | 0x44);
+            return -1;
+        }
+        int samples = count / 6;
+        if (samples > maxSamples) {
+            samples = maxSamples;
+        }
+        if (samples > MPU9250_FIFO_BURST) {
+            samples = MPU9250_FIFO_BURST;
+        }
+        if (samples == 0) {
+            return 0;
+        }
+        readBytes(_address, FIFO_R_W, 6 * samples, data, I2C_PRIORITY_HIGH);
+        for (int i = 0; i < 3 * samples; i++) {
+            dest[i] = (int16_t)(((int16_t)data[2 * i] << 8) | data[2 * i + 1]);
+        }
+        return samples;
+    }
+
+    // Let the MPU9250 poll the AK8963 on its auxiliary bus and close the bypass, so that the AK8963 no longer appears
+    // on the host bus. The AK8963 must already be configured by initAK8963().
+    void enableMagAuxMaster(void) {
+        writeByte(_address, USER_CTRL, 0x20);        // Enable I2C master mode (bit 5)
+        const RegisterSetting master[] = {
+            {I2C_MST_CTRL,  0xFF, 0x0D},    // Auxiliary I2C clock 400 kHz
+            {I2C_SLV0_ADDR, 0xFF, 0x80 | ((AK8963_ADDRESS) >> 1)}, // Read (bit 7) from the 7-bit AK8963 address
+            {I2C_SLV0_REG,  0xFF, AK8963_ST1},
+            {I2C_SLV0_CTRL, 0xFF, 0x88},    // Enable SLV0 and read 8 bytes: ST1, data and ST2
+            {INT_PIN_CFG,   0x02, 0x00},    // Keep the interrupt configuration, clear I2C_BYPASS_EN (bit 1)
+        };
+        applyConfig(master, sizeof(master) / sizeof(master[0]));
+        wait(0.01);
+    }
+
+    /*
+     * fast ... skip the settling delays (recover()); CLKSEL = 1 runs on the internal oscillator until the PLL is ready
+     */
+    void initMPU9250(bool fast = false) {
         // Initialize MPU9250 device
         // wake up device
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors
-        wait(0.1); // Delay 100 ms for PLL to get established on x-axis gyro; should check for PLL ready interrupt
+        writeByte(_address, PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors
+        if (!fast) {
+            wait(0.1); // Delay 100 ms for PLL to get established on x-axis gyro; should check for PLL ready interrupt
+        }
 
         // get stable time source
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x01);    // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
+        writeByte(_address, PWR_MGMT_1, 0x01);    // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
 
         // Configure Gyro and Accelerometer
-        // Disable FSYNC and set accelerometer and gyro bandwidth to 44 and 42 Hz, respectively;
-        // DLPF_CFG = bits 2:0 = 010; this sets the sample rate at 1 kHz for both
-        // Maximum delay is 4.9 ms which is just over a 200 Hz maximum rate
-        writeByte(MPU9250_ADDRESS, CONFIG, 0x03);
-
-        // Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
-        writeByte(MPU9250_ADDRESS, SMPLRT_DIV, 0x04);    // Use a 200 Hz rate; the same rate set in CONFIG above
-
-        // Set gyroscope full scale range
-        // Range selects FS_SEL and AFS_SEL are 0 - 3, so 2-bit values are left-shifted into positions 4:3
-        uint8_t c = readByte(MPU9250_ADDRESS, GYRO_CONFIG);
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, c & ~0xE0); // Clear self-test bits [7:5]
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, c & ~0x18); // Clear AFS bits [4:3]
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, c | _Mscale << 3); // Set full scale range for the gyro
-
-        // Set accelerometer configuration
-        c = readByte(MPU9250_ADDRESS, ACCEL_CONFIG);
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, c & ~0xE0); // Clear self-test bits [7:5]
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, c & ~0x18); // Clear AFS bits [4:3]
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, c | _Ascale << 3); // Set full scale range for the accelerometer
-
-        // Set accelerometer sample rate configuration
-        // It is possible to get a 4 kHz sample rate from the accelerometer by choosing 1 for
-        // accel_fchoice_b bit [3]; in this case the bandwidth is 1.13 kHz
-        c = readByte(MPU9250_ADDRESS, ACCEL_CONFIG2);
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG2, c & ~0x0F); // Clear accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0])
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG2, c | 0x03); // Set accelerometer rate to 1 kHz and bandwidth to 41 Hz
+        // SMPLRT_DIV..ACCEL_CONFIG2 are contiguous and written in one burst; after a reset the masked registers are
+        // read back once, also in one burst
+        const RegisterSetting config[] = {
+            // Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
+            {SMPLRT_DIV,    0xFF, _smplrtDiv},  // 200 Hz by default, or the rate of setSampleRate()
+            // Disable FSYNC and set accelerometer and gyro bandwidth to 44 and 42 Hz, respectively;
+            // DLPF_CFG = bits 2:0 = 011; this sets the sample rate at 1 kHz for both
+            // Maximum delay is 4.9 ms which is just over a 200 Hz maximum rate
+            {CONFIG,        0xFF, _dlpf},
+            // Clear self-test bits [7:5] and set the full scale range [4:3], keep FCHOICE_B [1:0]
+            {GYRO_CONFIG,   0xF8, (uint8_t) (_Gscale << 3)},
+            {ACCEL_CONFIG,  0xF8, (uint8_t) (_Ascale << 3)},
+            // Set accelerometer sample rate configuration
+            // It is possible to get a 4 kHz sample rate from the accelerometer by choosing 1 for
+            // accel_fchoice_b bit [3]; in this case the bandwidth is 1.13 kHz
+            // Clear accel_fchoice_b (bit 3) and set A_DLPFG (bits [2:0]): accelerometer rate 1 kHz and bandwidth 41 Hz
+            {ACCEL_CONFIG2, 0x0F, (uint8_t) (_accelFifo ? 0x08 : _dlpf)},
+        };
+        applyConfig(config, sizeof(config) / sizeof(config[0]));
 
         // The accelerometer, gyro, and thermometer are set to 1 kHz sample rates,
         // but all these rates are further reduced by a factor of 5 to 200 Hz because of the SMPLRT_DIV setting
@@ -344,13 +1194,31 @@ public:
         // Configure Interrupts and Bypass Enable
         // Set interrupt pin active high, push-pull, and clear on read of INT_STATUS, enable I2C_BYPASS_EN so additional chips
         // can join the I2C bus and all can be controlled by the Arduino as master
-        writeByte(MPU9250_ADDRESS, INT_PIN_CFG, 0x22);
-        writeByte(MPU9250_ADDRESS, INT_ENABLE, 0x01);    // Enable data ready (bit 0) interrupt
-        wait(0.1); // wait for pass-through mode enabled
+        const RegisterSetting interrupts[] = {
+            {INT_PIN_CFG,   0xFF, 0x22},
+            {INT_ENABLE,    0xFF, 0x01},    // Enable data ready (bit 0) interrupt
+        };
+        applyConfig(interrupts, sizeof(interrupts) / sizeof(interrupts[0]));
+        if (!fast) {
+            wait(0.1); // wait for pass-through mode enabled
+        }
     }
 
     // Function which accumulates gyro and accelerometer data after device initialization. It calculates the average
     // of the at-rest readings and then loads the resulting offsets into accelerometer and gyro bias registers.
+    /* "<label> X: <value>" per axis like printf("%f"), but with TextBuffer so that no float printf is needed */
+    static void printCalibration(const char* label, const float* values) {
+        for (int i = 0; i < 3; i++) {
+            TextBuffer<32> line;
+            char axis[5] = {' ', (char) ('X' + i), ':', ' ', 0};
+            line.append(label);
+            line.append(axis);
+            line.appendFloat(values[i]);
+            line.append("\r\n");
+            fwrite(line.data(), 1, line.length(), stdout);
+        }
+    }
+
     void accelgyrocalMPU9250(void) {
         float * dest1 = _gyroBias;
         float * dest2 = _accelBias;
@@ -360,47 +1228,47 @@ public:
         int32_t gyro_bias[3] = {0, 0, 0}, accel_bias[3] = {0, 0, 0};
 
         // reset device, reset all registers, clear gyro and accelerometer bias registers
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
+        writeByte(_address, PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
         wait(0.1);
 
         // get stable time source
         // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x01);
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_2, 0x00);
+        writeByte(_address, PWR_MGMT_1, 0x01);
+        writeByte(_address, PWR_MGMT_2, 0x00);
         wait(0.2);
 
         // Configure device for bias calculation
-        writeByte(MPU9250_ADDRESS, INT_ENABLE, 0x00);     // Disable all interrupts
-        writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00);            // Disable FIFO
-        writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x00);     // Turn on internal clock source
-        writeByte(MPU9250_ADDRESS, I2C_MST_CTRL, 0x00); // Disable I2C master
-        writeByte(MPU9250_ADDRESS, USER_CTRL, 0x00);        // Disable FIFO and I2C master modes
-        writeByte(MPU9250_ADDRESS, USER_CTRL, 0x0C);        // Reset FIFO and DMP
+        writeByte(_address, INT_ENABLE, 0x00);     // Disable all interrupts
+        writeByte(_address, FIFO_EN, 0x00);            // Disable FIFO
+        writeByte(_address, PWR_MGMT_1, 0x00);     // Turn on internal clock source
+        writeByte(_address, I2C_MST_CTRL, 0x00); // Disable I2C master
+        writeByte(_address, USER_CTRL, 0x00);        // Disable FIFO and I2C master modes
+        writeByte(_address, USER_CTRL, 0x0C);        // Reset FIFO and DMP
         wait(0.015);
 
         // Configure MPU9250 gyro and accelerometer for bias calculation
-        writeByte(MPU9250_ADDRESS, CONFIG, 0x01);            // Set low-pass filter to 188 Hz
-        writeByte(MPU9250_ADDRESS, SMPLRT_DIV, 0x00);    // Set sample rate to 1 kHz
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, 0x00);    // Set gyro full-scale to 250 degrees per second, maximum sensitivity
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, 0x00); // Set accelerometer full-scale to 2 g, maximum sensitivity
+        writeByte(_address, CONFIG, 0x01);            // Set low-pass filter to 188 Hz
+        writeByte(_address, SMPLRT_DIV, 0x00);    // Set sample rate to 1 kHz
+        writeByte(_address, GYRO_CONFIG, 0x00);    // Set gyro full-scale to 250 degrees per second, maximum sensitivity
+        writeByte(_address, ACCEL_CONFIG, 0x00); // Set accelerometer full-scale to 2 g, maximum sensitivity
 
         uint16_t gyrosensitivity  = 131;      // = 131 LSB/degrees/sec
         uint16_t accelsensitivity = 16384;    // = 16384 LSB/g
 
         // Configure FIFO to capture accelerometer and gyro data for bias calculation
-        writeByte(MPU9250_ADDRESS, USER_CTRL, 0x40);     // Enable FIFO
-        writeByte(MPU9250_ADDRESS, FIFO_EN, 0x78);         // Enable gyro and accelerometer sensors for FIFO (max size 512 bytes in MPU-9250)
+        writeByte(_address, USER_CTRL, 0x40);     // Enable FIFO
+        writeByte(_address, FIFO_EN, 0x78);         // Enable gyro and accelerometer sensors for FIFO (max size 512 bytes in MPU-9250)
         wait(0.04); // accumulate 40 samples in 80 milliseconds = 480 bytes
 
         // At end of sample accumulation, turn off FIFO sensor read
-        writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00);                // Disable gyro and accelerometer sensors for FIFO
-        readBytes(MPU9250_ADDRESS, FIFO_COUNTH, 2, &data[0]); // read FIFO sample count
+        writeByte(_address, FIFO_EN, 0x00);                // Disable gyro and accelerometer sensors for FIFO
+        readBytes(_address, FIFO_COUNTH, 2, &data[0]); // read FIFO sample count
         fifo_count = ((uint16_t)data[0] << 8) | data[1];
         packet_count = fifo_count/12;// How many sets of full gyro and accelerometer data for averaging
 
         for (ii = 0; ii < packet_count; ii++) {
             int16_t accel_temp[3] = {0, 0, 0}, gyro_temp[3] = {0, 0, 0};
-            readBytes(MPU9250_ADDRESS, FIFO_R_W, 12, &data[0]); // read data for averaging
+            readBytes(_address, FIFO_R_W, 12, &data[0]); // read data for averaging
             accel_temp[0] = (int16_t) (((int16_t)data[0] << 8) | data[1]    ) ;    // Form signed 16-bit integer for each sample in FIFO
             accel_temp[1] = (int16_t) (((int16_t)data[2] << 8) | data[3]    ) ;
             accel_temp[2] = (int16_t) (((int16_t)data[4] << 8) | data[5]    ) ;
@@ -436,20 +1304,18 @@ public:
 
         /// Push gyro biases to hardware registers
         /*
-            writeByte(MPU9250_ADDRESS, XG_OFFSET_H, data[0]);
-            writeByte(MPU9250_ADDRESS, XG_OFFSET_L, data[1]);
-            writeByte(MPU9250_ADDRESS, YG_OFFSET_H, data[2]);
-            writeByte(MPU9250_ADDRESS, YG_OFFSET_L, data[3]);
-            writeByte(MPU9250_ADDRESS, ZG_OFFSET_H, data[4]);
-            writeByte(MPU9250_ADDRESS, ZG_OFFSET_L, data[5]);
+            writeByte(_address, XG_OFFSET_H, data[0]);
+            writeByte(_address, XG_OFFSET_L, data[1]);
+            writeByte(_address, YG_OFFSET_H, data[2]);
+            writeByte(_address, YG_OFFSET_L, data[3]);
+            writeByte(_address, ZG_OFFSET_H, data[4]);
+            writeByte(_address, ZG_OFFSET_L, data[5]);
         */
         dest1[0] = (float) gyro_bias[0]/(float) gyrosensitivity; // construct gyro bias in deg/s for later manual subtraction
         dest1[1] = (float) gyro_bias[1]/(float) gyrosensitivity;
         dest1[2] = (float) gyro_bias[2]/(float) gyrosensitivity;
 
-        printf("GyroBias X: %f\r\n", dest1[0]);
-        printf("GyroBias Y: %f\r\n", dest1[1]);
-        printf("GyroBias Z: %f\r\n", dest1[2]);
+        printCalibration("GyroBias", dest1);
 
         // Construct the accelerometer biases for push to the hardware accelerometer bias registers. These registers contain
         // factory trim values which must be added to the calculated accelerometer biases; on boot up these registers will hold
@@ -458,11 +1324,11 @@ public:
         // the accelerometer biases calculated above must be divided by 8.
 
         int32_t accel_bias_reg[3] = {0, 0, 0}; // A place to hold the factory accelerometer trim biases
-        readBytes(MPU9250_ADDRESS, XA_OFFSET_H, 2, &data[0]); // Read factory accelerometer trim values
+        readBytes(_address, XA_OFFSET_H, 2, &data[0]); // Read factory accelerometer trim values
         accel_bias_reg[0] = (int16_t) ((int16_t)data[0] << 8) | data[1];
-        readBytes(MPU9250_ADDRESS, YA_OFFSET_H, 2, &data[0]);
+        readBytes(_address, YA_OFFSET_H, 2, &data[0]);
         accel_bias_reg[1] = (int16_t) ((int16_t)data[0] << 8) | data[1];
-        readBytes(MPU9250_ADDRESS, ZA_OFFSET_H, 2, &data[0]);
+        readBytes(_address, ZA_OFFSET_H, 2, &data[0]);
         accel_bias_reg[2] = (int16_t) ((int16_t)data[0] << 8) | data[1];
 
         uint32_t mask = 1uL; // Define mask for temperature compensation bit 0 of lower byte of accelerometer bias registers
@@ -490,21 +1356,21 @@ public:
         // Apparently this is not working for the acceleration biases in the MPU-9250
         // Are we handling the temperature correction bit properly?
         // Push accelerometer biases to hardware registers
-        /*    writeByte(MPU9250_ADDRESS, XA_OFFSET_H, data[0]);
-            writeByte(MPU9250_ADDRESS, XA_OFFSET_L, data[1]);
-            writeByte(MPU9250_ADDRESS, YA_OFFSET_H, data[2]);
-            writeByte(MPU9250_ADDRESS, YA_OFFSET_L, data[3]);
-            writeByte(MPU9250_ADDRESS, ZA_OFFSET_H, data[4]);
-            writeByte(MPU9250_ADDRESS, ZA_OFFSET_L, data[5]);
+        /*    writeByte(_address, XA_OFFSET_H, data[0]);
+            writeByte(_address, XA_OFFSET_L, data[1]);
+            writeByte(_address, YA_OFFSET_H, data[2]);
+            writeByte(_address, YA_OFFSET_L, data[3]);
+            writeByte(_address, ZA_OFFSET_H, data[4]);
+            writeByte(_address, ZA_OFFSET_L, data[5]);
         */
         // Output scaled accelerometer biases for manual subtraction in the main program
         dest2[0] = (float)accel_bias[0]/(float)accelsensitivity;
         dest2[1] = (float)accel_bias[1]/(float)accelsensitivity;
         dest2[2] = (float)accel_bias[2]/(float)accelsensitivity;
 
-        printf("AccelBias X: %f\r\n", dest2[0]);
-        printf("AccelBias Y: %f\r\n", dest2[1]);
-        printf("AccelBias Z: %f\r\n", dest2[2]);
+        printCalibration("AccelBias", dest2);
+        memcpy(_accelBiasBoot, _accelBias, sizeof(_accelBiasBoot));
+        _biasValid = false;
     }
 
 
@@ -517,20 +1383,20 @@ public:
         float factoryTrim[6];
         uint8_t FS = 0;
 
-        writeByte(MPU9250_ADDRESS, SMPLRT_DIV, 0x00); // Set gyro sample rate to 1 kHz
-        writeByte(MPU9250_ADDRESS, CONFIG, 0x02); // Set gyro sample rate to 1 kHz and DLPF to 92 Hz
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, 1<<FS); // Set full scale range for the gyro to 250 dps
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG2, 0x02); // Set accelerometer rate to 1 kHz and bandwidth to 92 Hz
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, 1<<FS); // Set full scale range for the accelerometer to 2 g
+        writeByte(_address, SMPLRT_DIV, 0x00); // Set gyro sample rate to 1 kHz
+        writeByte(_address, CONFIG, 0x02); // Set gyro sample rate to 1 kHz and DLPF to 92 Hz
+        writeByte(_address, GYRO_CONFIG, 1<<FS); // Set full scale range for the gyro to 250 dps
+        writeByte(_address, ACCEL_CONFIG2, 0x02); // Set accelerometer rate to 1 kHz and bandwidth to 92 Hz
+        writeByte(_address, ACCEL_CONFIG, 1<<FS); // Set full scale range for the accelerometer to 2 g
 
         for( int ii = 0; ii < 200; ii++) { // get average current values of gyro and acclerometer
 
-            readBytes(MPU9250_ADDRESS, ACCEL_XOUT_H, 6, &rawData[0]); // Read the six raw data registers into data array
+            readBytes(_address, ACCEL_XOUT_H, 6, &rawData[0]); // Read the six raw data registers into data array
             aAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ; // Turn the MSB and LSB into a signed 16-bit value
             aAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
             aAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
 
-            readBytes(MPU9250_ADDRESS, GYRO_XOUT_H, 6, &rawData[0]); // Read the six raw data registers sequentially into data array
+            readBytes(_address, GYRO_XOUT_H, 6, &rawData[0]); // Read the six raw data registers sequentially into data array
             gAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ; // Turn the MSB and LSB into a signed 16-bit value
             gAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
             gAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
@@ -542,18 +1408,18 @@ public:
         }
 
         // Configure the accelerometer for self-test
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, 0xE0); // Enable self test on all three axes and set accelerometer range to +/- 2 g
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, 0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
+        writeByte(_address, ACCEL_CONFIG, 0xE0); // Enable self test on all three axes and set accelerometer range to +/- 2 g
+        writeByte(_address, GYRO_CONFIG, 0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
         wait_ms(25); // Delay a while to let the device stabilize
 
         for( int ii = 0; ii < 200; ii++) { // get average self-test values of gyro and acclerometer
 
-            readBytes(MPU9250_ADDRESS, ACCEL_XOUT_H, 6, &rawData[0]); // Read the six raw data registers into data array
+            readBytes(_address, ACCEL_XOUT_H, 6, &rawData[0]); // Read the six raw data registers into data array
             aSTAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ; // Turn the MSB and LSB into a signed 16-bit value
             aSTAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
             aSTAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
 
-            readBytes(MPU9250_ADDRESS, GYRO_XOUT_H, 6, &rawData[0]); // Read the six raw data registers sequentially into data array
+            readBytes(_address, GYRO_XOUT_H, 6, &rawData[0]); // Read the six raw data registers sequentially into data array
             gSTAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ; // Turn the MSB and LSB into a signed 16-bit value
             gSTAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;
             gSTAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ;
@@ -565,17 +1431,17 @@ public:
         }
 
         // Configure the gyro and accelerometer for normal operation
-        writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, 0x00);
-        writeByte(MPU9250_ADDRESS, GYRO_CONFIG, 0x00);
+        writeByte(_address, ACCEL_CONFIG, 0x00);
+        writeByte(_address, GYRO_CONFIG, 0x00);
         wait_ms(25); // Delay a while to let the device stabilize
 
         // Retrieve accelerometer and gyro factory Self-Test Code from USR_Reg
-        selfTest[0] = readByte(MPU9250_ADDRESS, SELF_TEST_X_ACCEL); // X-axis accel self-test results
-        selfTest[1] = readByte(MPU9250_ADDRESS, SELF_TEST_Y_ACCEL); // Y-axis accel self-test results
-        selfTest[2] = readByte(MPU9250_ADDRESS, SELF_TEST_Z_ACCEL); // Z-axis accel self-test results
-        selfTest[3] = readByte(MPU9250_ADDRESS, SELF_TEST_X_GYRO); // X-axis gyro self-test results
-        selfTest[4] = readByte(MPU9250_ADDRESS, SELF_TEST_Y_GYRO); // Y-axis gyro self-test results
-        selfTest[5] = readByte(MPU9250_ADDRESS, SELF_TEST_Z_GYRO); // Z-axis gyro self-test results
+        selfTest[0] = readByte(_address, SELF_TEST_X_ACCEL); // X-axis accel self-test results
+        selfTest[1] = readByte(_address, SELF_TEST_Y_ACCEL); // Y-axis accel self-test results
+        selfTest[2] = readByte(_address, SELF_TEST_Z_ACCEL); // Z-axis accel self-test results
+        selfTest[3] = readByte(_address, SELF_TEST_X_GYRO); // X-axis gyro self-test results
+        selfTest[4] = readByte(_address, SELF_TEST_Y_GYRO); // Y-axis gyro self-test results
+        selfTest[5] = readByte(_address, SELF_TEST_Z_GYRO); // Z-axis gyro self-test results
 
         // Retrieve factory self-test value from self-test code reads
         factoryTrim[0] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[0] - 1.0) )); // FT[Xa] factory trim calculation
@@ -597,126 +1463,63 @@ public:
 
     /* uint8_t out[4 * 4], Quaternion in NED(w,x,y,z) */
     void performMadgwickQuaternionUpdate(uint8_t *out) {
+        _fusionEpoch++;
+#if MPU9250_FUSION_FIXED_POINT
+        uint32_t now = _timer.read_us();
+        uint32_t elapsed = now - _lastUpdate;
+        _lastUpdate = now;
+        if (elapsed > 1000000) {
+            elapsed = 1000000; // Q5.26 holds at most 32 s; longer gaps carry no useful integration anyway
+        }
+        fx_t deltat = (fx_t) (((int64_t) elapsed * 70368744) >> 20); // us to Q5.26 seconds (2^46 / 10^6)
+        // Body frame NED, see below
+        MadgwickQuaternionUpdateFixed(_qFx, deltat, -_aFx[0], -_aFx[1], -_aFx[2], _gFx[0], _gFx[1], _gFx[2], _mFx[0], _mFx[1], _mFx[2]);
+        for (int i = 0; i < 4; i++) {
+            ((int32_t *) out)[i] = fx_to_out(_qFx[i]);
+        }
+#else
         uint32_t now = _timer.read_us();
         _deltat = ((now - _lastUpdate) / 1000000.0f); // set integration time by time elapsed since last filter update
         _lastUpdate = now;
         float* out_data = (float *) out;
-        // Sensors x (y)-axis of the accelerometer/gyro is aligned with the y (x)axis of the magnetometer;
-        // the magnetometer z-axis (+ down) is misaligned with z-axis (+ up) of accelerometer and gyro!
-        // We have to make some allowance for this orientation mismatch in feeding the output to the quaternion filter.
-        // We will assume that +y accel/gyro is North, then x accel/gyro is East. So if we want te quaternions properly aligned
-        // we need to feed into the madgwick function Ay, Ax, -Az, Gy, Gx, -Gz, Mx, My, and Mz. But because gravity is by convention
-        // positive down, we need to invert the accel data, so we pass -Ay, -Ax, Az, Gy, Gx, -Gz, Mx, My, and Mz into the Madgwick
-        // function to get North along the accel +y-axis, East along the accel +x-axis, and Down along the accel -z-axis.
-        // This orientation choice can be modified to allow any convenient (non-NED) orientation convention.
-        // This is ok by aircraft orientation standards!
+        // The samples are already in the NED body frame (MPU9250_MOUNT), with the AK8963 axes mapped onto the accel/gyro
+        // axes. The filter expects the accelerometer pointing down at rest, the inverse of the measured specific force.
         // Pass gyro rate as rad/s
-        // MadgwickQuaternionUpdate(-ay, -ax, az, gy*PI/180.0f, gx*PI/180.0f, -gz*PI/180.0f,  mx,  my, mz);
-        // if(passThru)MahonyQuaternionUpdate(-ay, -ax, az, gy*PI/180.0f, gx*PI/180.0f, -gz*PI/180.0f,  mx,  my, mz);
-        // NED:
-        MadgwickQuaternionUpdate(-_a[1], -_a[0], _a[2], _g[1], _g[0], -_g[2], _m[0], _m[1], _m[2]);
+        MadgwickQuaternionUpdate(-_a[0], -_a[1], -_a[2], _g[0], _g[1], _g[2], _m[0], _m[1], _m[2]);
         out_data[0] = _q[0];  // NED +W
         out_data[1] = _q[1];  // NED +X
         out_data[2] = _q[2];  // NED +Y
         out_data[3] = _q[3];  // NED +Z
+#endif
     }
 
-    // Implementation of Sebastian Madgwick's "...efficient orientation filter for... inertial/magnetic sensor arrays"
-    // (see http://www.x-io.co.uk/category/open-source/ for examples and more details)
-    // which fuses acceleration, rotation rate, and magnetic moments to produce a quaternion-based estimate of absolute
-    // device orientation -- which can be converted to yaw, pitch, and roll. Useful for stabilizing quadcopters, etc.
-    // The performance of the orientation filter is at least as good as conventional Kalman-based filtering algorithms
-    // but is much less computationally intensive---it can be performed on a 3.3 V Pro Mini operating at 8 MHz!
+    /*
+     * State of the last filter update for DerivedOrientation::update(): quaternion (w, x, y, z) and the accelerometer
+     * vector in the NED body frame as fed to the filter (g, pointing down at rest). Returns the epoch of the update.
+     */
+    uint32_t getFusionState(float* q, float* accel) {
+#if MPU9250_FUSION_FIXED_POINT
+        for (int i = 0; i < 4; i++) {
+            q[i] = fx_to_float(_qFx[i]);
+        }
+        for (int i = 0; i < 3; i++) {
+            accel[i] = -fx_to_float(_aFx[i]);
+        }
+#else
+        for (int i = 0; i < 4; i++) {
+            q[i] = _q[i];
+        }
+        for (int i = 0; i < 3; i++) {
+            accel[i] = -_a[i];
+        }
+#endif
+        return _fusionEpoch;
+    }
+
+    // See madgwick.hpp
     void MadgwickQuaternionUpdate(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz)
     {
-        float q1 = _q[0], q2 = _q[1], q3 = _q[2], q4 = _q[3];     // short name local variable for readability
-        float norm;
-        float hx, hy, _2bx, _2bz;
-        float s1, s2, s3, s4;
-        float qDot1, qDot2, qDot3, qDot4;
-
-        // Auxiliary variables to avoid repeated arithmetic
-        float _2q1mx;
-        float _2q1my;
-        float _2q1mz;
-        float _2q2mx;
-        float _4bx;
-        float _4bz;
-        float _2q1 = 2.0f * q1;
-        float _2q2 = 2.0f * q2;
-        float _2q3 = 2.0f * q3;
-        float _2q4 = 2.0f * q4;
-        float _2q1q3 = 2.0f * q1 * q3;
-        float _2q3q4 = 2.0f * q3 * q4;
-        float q1q1 = q1 * q1;
-        float q1q2 = q1 * q2;
-        float q1q3 = q1 * q3;
-        float q1q4 = q1 * q4;
-        float q2q2 = q2 * q2;
-        float q2q3 = q2 * q3;
-        float q2q4 = q2 * q4;
-        float q3q3 = q3 * q3;
-        float q3q4 = q3 * q4;
-        float q4q4 = q4 * q4;
-
-        // Normalise accelerometer measurement
-        norm = sqrt(ax * ax + ay * ay + az * az);
-        if (norm == 0.0f) return; // handle NaN
-        norm = 1.0f/norm;
-        ax *= norm;
-        ay *= norm;
-        az *= norm;
-
-        // Normalise magnetometer measurement
-        norm = sqrt(mx * mx + my * my + mz * mz);
-        if (norm == 0.0f) return; // handle NaN
-        norm = 1.0f/norm;
-        mx *= norm;
-        my *= norm;
-        mz *= norm;
-
-        // Reference direction of Earth's magnetic field
-        _2q1mx = 2.0f * q1 * mx;
-        _2q1my = 2.0f * q1 * my;
-        _2q1mz = 2.0f * q1 * mz;
-        _2q2mx = 2.0f * q2 * mx;
-        hx = mx * q1q1 - _2q1my * q4 + _2q1mz * q3 + mx * q2q2 + _2q2 * my * q3 + _2q2 * mz * q4 - mx * q3q3 - mx * q4q4;
-        hy = _2q1mx * q4 + my * q1q1 - _2q1mz * q2 + _2q2mx * q3 - my * q2q2 + my * q3q3 + _2q3 * mz * q4 - my * q4q4;
-        _2bx = sqrt(hx * hx + hy * hy);
-        _2bz = -_2q1mx * q3 + _2q1my * q2 + mz * q1q1 + _2q2mx * q4 - mz * q2q2 + _2q3 * my * q4 - mz * q3q3 + mz * q4q4;
-        _4bx = 2.0f * _2bx;
-        _4bz = 2.0f * _2bz;
-
-        // Gradient decent algorithm corrective step
-        s1 = -_2q3 * (2.0f * q2q4 - _2q1q3 - ax) + _2q2 * (2.0f * q1q2 + _2q3q4 - ay) - _2bz * q3 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q4 + _2bz * q2) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q3 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-        s2 = _2q4 * (2.0f * q2q4 - _2q1q3 - ax) + _2q1 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q2 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + _2bz * q4 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q3 + _2bz * q1) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q4 - _4bz * q2) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-        s3 = -_2q1 * (2.0f * q2q4 - _2q1q3 - ax) + _2q4 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q3 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + (-_4bx * q3 - _2bz * q1) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q2 + _2bz * q4) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q1 - _4bz * q3) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-        s4 = _2q2 * (2.0f * q2q4 - _2q1q3 - ax) + _2q3 * (2.0f * q1q2 + _2q3q4 - ay) + (-_4bx * q4 + _2bz * q2) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q1 + _2bz * q3) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q2 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-        norm = sqrt(s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4);        // normalise step magnitude
-        norm = 1.0f/norm;
-        s1 *= norm;
-        s2 *= norm;
-        s3 *= norm;
-        s4 *= norm;
-
-        // Compute rate of change of quaternion
-        qDot1 = 0.5f * (-q2 * gx - q3 * gy - q4 * gz) - BETA * s1;
-        qDot2 = 0.5f * (q1 * gx + q3 * gz - q4 * gy) - BETA * s2;
-        qDot3 = 0.5f * (q1 * gy - q2 * gz + q4 * gx) - BETA * s3;
-        qDot4 = 0.5f * (q1 * gz + q2 * gy - q3 * gx) - BETA * s4;
-
-        // Integrate to yield quaternion
-        q1 += qDot1 * _deltat;
-        q2 += qDot2 * _deltat;
-        q3 += qDot3 * _deltat;
-        q4 += qDot4 * _deltat;
-        norm = sqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);        // normalise quaternion
-        norm = 1.0f/norm;
-        _q[0] = q1 * norm;
-        _q[1] = q2 * norm;
-        _q[2] = q3 * norm;
-        _q[3] = q4 * norm;
-
+        ::MadgwickQuaternionUpdate(_q, _deltat, ax, ay, az, gx, gy, gz, mx, my, mz);
     }
 
     // Similar to Madgwick scheme but uses proportional and integral filtering on the error between estimated reference vectors and
@@ -848,9 +1651,7 @@ public:
         dest1[1] = (float) mag_bias[1]*_mRes*_magCalibration[1];
         dest1[2] = (float) mag_bias[2]*_mRes*_magCalibration[2];
 
-        printf("MagBias X: %f\r\n", dest1[0]);
-        printf("MagBias Y: %f\r\n", dest1[1]);
-        printf("MagBias Z: %f\r\n", dest1[2]);
+        printCalibration("MagBias", dest1);
 
         if (!dest2) {
             return;
@@ -868,9 +1669,7 @@ public:
         dest2[1] = avg_rad/((float)mag_scale[1]);
         dest2[2] = avg_rad/((float)mag_scale[2]);
 
-        printf("MagScale X: %f\r\n", dest2[0]);
-        printf("MagScale Y: %f\r\n", dest2[1]);
-        printf("MagScale Z: %f\r\n", dest2[2]);
+        printCalibration("MagScale", dest2);
     }
 };
 #endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/MPU9250.hpp"
+
+// On-target benchmarks, enabled by building with MPU9250_BENCHMARK=1 (`make benchmark`).
+// Results are printed over the USB serial port once the sensor has been initialized.
+#ifndef MPU9250_BENCHMARK
+#define MPU9250_BENCHMARK 0
+#endif
+
+void mpu9250_benchmark(MPU9250* sensor);
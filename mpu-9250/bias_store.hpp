@@ -0,0 +1,50 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/bias_table.hpp"
+
+#if DEVICE_FLASH
+// Keeps a TempBiasTable in the last sector of the internal flash.
+//
+// The sector must not hold firmware; reserve it in the linker script or check that the image ends before it.
+// save() erases and programs the sector, so call it rarely (e.g. every few minutes while the table changes).
+#define BIAS_STORE_BUFFER_SIZE 1024     // serialized table rounded up to the program page size
+
+class BiasTableStore {
+    FlashIAP _flash;
+    uint32_t _address;
+    uint32_t _sectorSize;
+    uint8_t _buffer[BIAS_STORE_BUFFER_SIZE];
+
+public:
+    BiasTableStore() {
+        _flash.init();
+        uint32_t end = _flash.get_flash_start() + _flash.get_flash_size();
+        _sectorSize = _flash.get_sector_size(end - 1);
+        _address = end - _sectorSize;
+    }
+
+    ~BiasTableStore() {
+        _flash.deinit();
+    }
+
+    /* Returns false and keeps `table` if the sector holds no valid table */
+    bool load(TempBiasTable* table) {
+        if (_flash.read(_buffer, _address, TempBiasTable::serializedSize()) != 0) {
+            return false;
+        }
+        return table->deserialize(_buffer);
+    }
+
+    bool save(const TempBiasTable& table) {
+        uint32_t page = _flash.get_page_size();
+        uint32_t size = (TempBiasTable::serializedSize() + page - 1) / page * page;
+        if (size > sizeof(_buffer)) {
+            return false;
+        }
+        memset(_buffer, 0xFF, size);
+        table.serialize(_buffer);
+        return _flash.erase(_address, _sectorSize) == 0 && _flash.program(_buffer, _address, size) == 0;
+    }
+};
+#endif
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Temperature-indexed gyro and accelerometer bias.
+//
+// The table has one bin per BIAS_TABLE_T_STEP degrees from BIAS_TABLE_T_MIN. A bin holds the gyro bias (dps) and an
+// accelerometer correction (g) on top of the boot-time calibration, learned while the sensor is stationary. Only the
+// accelerometer bias component along gravity is observable without a reference orientation, so the correction of a bin
+// converges as the sensor rests in different orientations at that temperature.
+// lookup() interpolates linearly between the nearest learned bins and holds the value of the outermost learned bin
+// beyond them. The table has no mbed dependency and a fixed serialized size, so it can be stored as a blob.
+#define BIAS_TABLE_T_MIN        -20.0f
+#define BIAS_TABLE_T_STEP       2.5f
+#define BIAS_TABLE_BINS         33      // -20 to 60 degC
+#define BIAS_TABLE_MAX_WEIGHT   32      // a learned window counts 1/32 once a bin has settled
+#define BIAS_TABLE_MAGIC        0x42544231  // "BTB1"
+
+struct BiasBin {
+    float gyro[3];                      // dps
+    float accel[3];                     // g, added to the boot-time accelerometer bias
+    uint16_t weight;                    // learned windows, saturating at BIAS_TABLE_MAX_WEIGHT; 0 = empty
+};
+
+class TempBiasTable {
+    BiasBin _bins[BIAS_TABLE_BINS];
+
+    static int binIndex(float tempC) {
+        int i = (int) floorf((tempC - BIAS_TABLE_T_MIN) / BIAS_TABLE_T_STEP + 0.5f);
+        return i < 0 ? 0 : i >= BIAS_TABLE_BINS ? BIAS_TABLE_BINS - 1 : i;
+    }
+
+    static uint32_t checksum(const uint8_t* data, size_t length) {
+        uint32_t sum1 = 0, sum2 = 0;
+        for (size_t i = 0; i < length; i++) {
+            sum1 = (sum1 + data[i]) % 65535;
+            sum2 = (sum2 + sum1) % 65535;
+        }
+        return sum2 << 16 | sum1;
+    }
+
+public:
+    TempBiasTable() {
+        clear();
+    }
+
+    void clear(void) {
+        memset(_bins, 0, sizeof(_bins));
+    }
+
+    const BiasBin& getBin(int index) const {
+        return _bins[index];
+    }
+
+    static float binTemperature(int index) {
+        return BIAS_TABLE_T_MIN + index * BIAS_TABLE_T_STEP;
+    }
+
+    /*
+     * Fold the mean of a stationary window into the bin of `tempC`.
+     * gyro ... mean rate (dps) without bias compensation
+     * accel ... accelerometer correction observed in the window (g)
+     */
+    void learn(float tempC, const float* gyro, const float* accel) {
+        BiasBin* bin = &_bins[binIndex(tempC)];
+        if (bin->weight < BIAS_TABLE_MAX_WEIGHT) {
+            bin->weight++;
+        }
+        float k = 1.0f / bin->weight;
+        for (int i = 0; i < 3; i++) {
+            bin->gyro[i] += (gyro[i] - bin->gyro[i]) * k;
+            bin->accel[i] += (accel[i] - bin->accel[i]) * k;
+        }
+    }
+
+    /*
+     * Interpolated bias at `tempC`. Returns false and leaves the outputs untouched when nothing has been learned.
+     */
+    bool lookup(float tempC, float* gyro, float* accel) const {
+        float x = (tempC - BIAS_TABLE_T_MIN) / BIAS_TABLE_T_STEP;
+        int lo = -1, hi = -1;
+        for (int i = 0; i < BIAS_TABLE_BINS; i++) {
+            if (!_bins[i].weight) {
+                continue;
+            }
+            if (i <= x) {
+                lo = i;
+            } else if (hi < 0) {
+                hi = i;
+            }
+        }
+        if (lo < 0 && hi < 0) {
+            return false;
+        }
+        const BiasBin* a = &_bins[lo >= 0 ? lo : hi];
+        const BiasBin* b = &_bins[hi >= 0 ? hi : lo];
+        float t = (lo >= 0 && hi >= 0) ? (x - lo) / (hi - lo) : 0.0f;
+        for (int i = 0; i < 3; i++) {
+            gyro[i] = a->gyro[i] + (b->gyro[i] - a->gyro[i]) * t;
+            accel[i] = a->accel[i] + (b->accel[i] - a->accel[i]) * t;
+        }
+        return true;
+    }
+
+    static size_t serializedSize(void) {
+        return 4 + sizeof(_bins) + 4;
+    }
+
+    /* Write the table with a magic number and checksum into `out` (serializedSize() bytes) */
+    void serialize(uint8_t* out) const {
+        uint32_t magic = BIAS_TABLE_MAGIC;
+        memcpy(out, &magic, 4);
+        memcpy(out + 4, _bins, sizeof(_bins));
+        uint32_t sum = checksum(out, 4 + sizeof(_bins));
+        memcpy(out + 4 + sizeof(_bins), &sum, 4);
+    }
+
+    /* Restore a table written by serialize(); returns false and keeps the table if the data is not valid */
+    bool deserialize(const uint8_t* in) {
+        uint32_t magic, sum;
+        memcpy(&magic, in, 4);
+        memcpy(&sum, in + 4 + sizeof(_bins), 4);
+        if (magic != BIAS_TABLE_MAGIC || sum != checksum(in, 4 + sizeof(_bins))) {
+            return false;
+        }
+        memcpy(_bins, in + 4, sizeof(_bins));
+        return true;
+    }
+};
+
+// Detects stationary windows in the uncompensated sample stream and feeds their means into a TempBiasTable.
+//
+// A window of BIAS_LEARN_SAMPLES samples is stationary when the peak-to-peak variation of every gyro and accel axis
+// stays below the thresholds and the acceleration magnitude is close to 1 g.
+#define BIAS_LEARN_SAMPLES          200     // 1 s at 200 Hz
+#define BIAS_LEARN_GYRO_SPAN        0.6f    // dps, several times the noise at 41 Hz bandwidth
+#define BIAS_LEARN_ACCEL_SPAN       0.03f   // g
+#define BIAS_LEARN_ACCEL_NORM_TOL   0.1f    // g
+
+class BiasLearner {
+    TempBiasTable* _table;
+    uint16_t _count = 0;
+    float _sum[7];                      // gyro x/y/z (dps), accel x/y/z (g), temperature (degC)
+    float _min[6], _max[6];
+    uint32_t _learned = 0;
+
+public:
+    BiasLearner(TempBiasTable* table): _table(table) {
+    }
+
+    /*
+     * gyro ... rate without bias compensation (dps)
+     * accel ... acceleration with the boot-time bias removed (g)
+     * Returns true when a stationary window has just been learned.
+     */
+    bool update(const float* gyro, const float* accel, float tempC) {
+        if (_count == 0) {
+            memset(_sum, 0, sizeof(_sum));
+            for (int i = 0; i < 3; i++) {
+                _min[i] = _max[i] = gyro[i];
+                _min[3 + i] = _max[3 + i] = accel[i];
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            _sum[i] += gyro[i];
+            _sum[3 + i] += accel[i];
+            _min[i] = fminf(_min[i], gyro[i]);
+            _max[i] = fmaxf(_max[i], gyro[i]);
+            _min[3 + i] = fminf(_min[3 + i], accel[i]);
+            _max[3 + i] = fmaxf(_max[3 + i], accel[i]);
+        }
+        _sum[6] += tempC;
+        if (++_count < BIAS_LEARN_SAMPLES) {
+            return false;
+        }
+        _count = 0;
+
+        for (int i = 0; i < 3; i++) {
+            if (_max[i] - _min[i] > BIAS_LEARN_GYRO_SPAN || _max[3 + i] - _min[3 + i] > BIAS_LEARN_ACCEL_SPAN) {
+                return false;
+            }
+        }
+        float gyroMean[3], accelMean[3], correction[3];
+        for (int i = 0; i < 3; i++) {
+            gyroMean[i] = _sum[i] / BIAS_LEARN_SAMPLES;
+            accelMean[i] = _sum[3 + i] / BIAS_LEARN_SAMPLES;
+        }
+        float norm = sqrtf(accelMean[0] * accelMean[0] + accelMean[1] * accelMean[1] + accelMean[2] * accelMean[2]);
+        if (fabsf(norm - 1.0f) > BIAS_LEARN_ACCEL_NORM_TOL) {
+            return false;
+        }
+        // Residual along gravity: the measured vector minus a 1 g vector in the same direction
+        for (int i = 0; i < 3; i++) {
+            correction[i] = accelMean[i] * (norm - 1.0f) / norm;
+        }
+        _table->learn(_sum[6] / BIAS_LEARN_SAMPLES, gyroMean, correction);
+        _learned++;
+        return true;
+    }
+
+    uint32_t getLearnedCount(void) {
+        return _learned;
+    }
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "mbed.h"
+
+// CPU cycle counter used by the benchmarks.
+// Cortex-M3/M4/M7 provide DWT->CYCCNT; other cores fall back to the microsecond ticker scaled by the core clock.
+
+inline void cycle_counter_init(void) {
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+inline uint32_t cycle_counter_read(void) {
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    return DWT->CYCCNT;
+#else
+    return us_ticker_read() * (SystemCoreClock / 1000000);
+#endif
+}
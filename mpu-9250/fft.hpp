@@ -0,0 +1,179 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Real FFT and vibration spectrum of a block of raw accelerometer samples, without mbed dependencies so that the
+// analysis can be benchmarked on the host (tools/fft_bench.cpp).
+
+// Real input FFT of N points (power of two) as an N/2 point complex radix-2 FFT plus a split step.
+// forward() works in place and leaves the spectrum packed: data[0] = X[0], data[1] = X[N/2] (both real), and
+// data[2k], data[2k + 1] = Re, Im of X[k] for 0 < k < N/2.
+template <int N>
+class RealFFT {
+    static_assert(N >= 8 && (N & (N - 1)) == 0, "N must be a power of two of at least 8");
+
+    float _cos[N / 2];                  // e^(-2 pi i k / N) = _cos[k] - i _sin[k]
+    float _sin[N / 2];
+    uint16_t _reverse[N / 2];           // bit reversal of the complex FFT indexes
+
+public:
+    RealFFT() {
+        const float pi = 3.14159265358979323846f;
+        for (int k = 0; k < N / 2; k++) {
+            _cos[k] = cosf(2.0f * pi * k / N);
+            _sin[k] = sinf(2.0f * pi * k / N);
+        }
+        for (int i = 0, j = 0; i < N / 2; i++) {
+            _reverse[i] = j;
+            int bit = N / 4;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j |= bit;
+        }
+    }
+
+    void forward(float* data) {
+        const int M = N / 2;            // complex points z[n] = data[2n] + i data[2n + 1]
+        for (int i = 0; i < M; i++) {
+            int j = _reverse[i];
+            if (i < j) {
+                float re = data[2 * i], im = data[2 * i + 1];
+                data[2 * i] = data[2 * j];
+                data[2 * i + 1] = data[2 * j + 1];
+                data[2 * j] = re;
+                data[2 * j + 1] = im;
+            }
+        }
+        for (int length = 2; length <= M; length <<= 1) {
+            int half = length >> 1;
+            int step = 2 * (M / length);  // twiddle index step in the N-point table
+            for (int start = 0; start < M; start += length) {
+                for (int k = 0; k < half; k++) {
+                    float wr = _cos[k * step], wi = -_sin[k * step];
+                    float* a = &data[2 * (start + k)];
+                    float* b = &data[2 * (start + k + half)];
+                    float tr = b[0] * wr - b[1] * wi;
+                    float ti = b[0] * wi + b[1] * wr;
+                    b[0] = a[0] - tr;
+                    b[1] = a[1] - ti;
+                    a[0] += tr;
+                    a[1] += ti;
+                }
+            }
+        }
+
+        // Split: X[k] = E[k] + W^k O[k] with E, O the spectra of the even and odd samples
+        float re0 = data[0], im0 = data[1];
+        data[0] = re0 + im0;
+        data[1] = re0 - im0;
+        for (int k = 1; k <= M / 2; k++) {
+            float* zk = &data[2 * k];
+            float* zm = &data[2 * (M - k)];
+            float er = 0.5f * (zk[0] + zm[0]), ei = 0.5f * (zk[1] - zm[1]);
+            float or_ = 0.5f * (zk[1] + zm[1]), oi = -0.5f * (zk[0] - zm[0]);
+            float wr = _cos[k], wi = -_sin[k];
+            float tr = wr * or_ - wi * oi;
+            float ti = wr * oi + wi * or_;
+            zk[0] = er + tr;
+            zk[1] = ei + ti;
+            if (k != M - k) {
+                // X[N/2 - k] = conj(E[k] - W^k O[k])
+                zm[0] = er - tr;
+                zm[1] = ti - ei;
+            }
+        }
+    }
+};
+
+#ifndef VIBRATION_BANDS
+#define VIBRATION_BANDS 8               // equal-width bands from 0 Hz to the Nyquist frequency
+#endif
+
+struct VibrationSpectrum {
+    uint32_t block;                     // sequence number of the analysed block
+    float rms;                          // acceleration RMS without the mean (g)
+    float peakHz;                       // strongest component, interpolated between bins
+    float peakAmplitude;                // amplitude of the strongest component (g)
+    float bands[VIBRATION_BANDS];       // mean square acceleration per band (g^2), sums up to about rms^2
+};
+
+// Hann-windowed spectrum of N raw samples of one accelerometer axis
+template <int N>
+class VibrationAnalysis {
+    RealFFT<N> _fft;
+    float _window[N];
+    float _work[N];
+    float _amplitudeScale;              // 2 / sum(w): bin magnitude to amplitude
+    float _powerScale;                  // 2 / (N sum(w^2)): squared bin magnitude to mean square
+    float _sampleRate;
+    float _scale;                       // g per LSB
+
+public:
+    /*
+     * sampleRate ... Hz
+     * scale ... accelerometer resolution, g per LSB
+     */
+    VibrationAnalysis(float sampleRate, float scale): _sampleRate(sampleRate), _scale(scale) {
+        const float pi = 3.14159265358979323846f;
+        float sum = 0.0f, sumSquares = 0.0f;
+        for (int i = 0; i < N; i++) {
+            _window[i] = 0.5f - 0.5f * cosf(2.0f * pi * i / N);   // periodic Hann
+            sum += _window[i];
+            sumSquares += _window[i] * _window[i];
+        }
+        _amplitudeScale = 2.0f / sum;
+        _powerScale = 2.0f / (N * sumSquares);
+    }
+
+    float getSampleRate(void) const {
+        return _sampleRate;
+    }
+
+    void analyze(const int16_t* samples, VibrationSpectrum* out) {
+        int32_t sum = 0;
+        for (int i = 0; i < N; i++) {
+            sum += samples[i];
+        }
+        float mean = (float) sum / N;
+        float squares = 0.0f;
+        for (int i = 0; i < N; i++) {
+            float v = ((float) samples[i] - mean) * _scale;
+            squares += v * v;
+            _work[i] = v * _window[i];
+        }
+        out->rms = sqrtf(squares / N);
+
+        _fft.forward(_work);
+
+        // Squared magnitudes of bins 1..N/2-1 replace their real parts; DC is zero after removing the mean
+        int peak = 1;
+        for (int k = 1; k < N / 2; k++) {
+            float p = _work[2 * k] * _work[2 * k] + _work[2 * k + 1] * _work[2 * k + 1];
+            _work[k] = p;
+            if (p > _work[peak]) {
+                peak = k;
+            }
+        }
+        memset(out->bands, 0, sizeof(out->bands));
+        for (int k = 1; k < N / 2; k++) {
+            out->bands[k * VIBRATION_BANDS / (N / 2)] += _work[k] * _powerScale;
+        }
+
+        // Parabolic interpolation of the magnitudes around the peak, also for the amplitude between two bins
+        float delta = 0.0f;
+        float magnitude = sqrtf(_work[peak]);
+        if (peak > 1 && peak < N / 2 - 1) {
+            float a = sqrtf(_work[peak - 1]), c = sqrtf(_work[peak + 1]);
+            float d = a - 2.0f * magnitude + c;
+            if (d < 0.0f) {
+                delta = 0.5f * (a - c) / d;
+                magnitude -= 0.25f * (a - c) * delta;
+            }
+        }
+        out->peakHz = (peak + delta) * _sampleRate / N;
+        out->peakAmplitude = magnitude * _amplitudeScale;
+    }
+};
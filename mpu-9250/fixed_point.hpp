@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+// Signed Q-format arithmetic for the fixed-point fusion path (MPU9250_FUSION_FIXED_POINT=1).
+//
+// fx_t is Q5.26 (range +-32, resolution 1.5e-8) and holds the fusion state and inputs: accel (g), gyro (rad/s),
+// unit vectors and the quaternion. Gyro rates beyond +-32 rad/s (1833 dps) do not fit, so GFS_2000DPS is not supported.
+// Accel in g fits for every range up to AFS_16G; in m/s2 it would not (+-32 m/s2 is 3.26 g), so it is only formed in
+// the output format with fx_mul_to_out().
+// Output buffers use Q15.16 (FX_OUT_FRAC_BITS) so that m/s2 and mG values fit as well.
+// Products go through a 32x32->64 bit multiply (SMULL on Cortex-M3/M4) and need no FPU.
+// This header does not depend on mbed so that it can be built on the host.
+typedef int32_t fx_t;
+
+#define FX_FRAC_BITS        26
+#define FX_ONE              ((fx_t) 1 << FX_FRAC_BITS)
+#define FX_OUT_FRAC_BITS    16
+
+// Conversions from float are meant for constants and initialization, not for the per-sample path
+inline fx_t fx_from_float(float f, int frac_bits = FX_FRAC_BITS) {
+    f *= (float) ((int32_t) 1 << frac_bits);
+    return (fx_t) (f >= 0.0f ? f + 0.5f : f - 0.5f);
+}
+
+inline float fx_to_float(int32_t x, int frac_bits = FX_FRAC_BITS) {
+    return (float) x / (float) ((int32_t) 1 << frac_bits);
+}
+
+inline int32_t fx_to_out(fx_t x) {
+    return x >> (FX_FRAC_BITS - FX_OUT_FRAC_BITS);
+}
+
+inline fx_t fx_mul(fx_t a, fx_t b) {
+    return (fx_t) (((int64_t) a * b) >> FX_FRAC_BITS);
+}
+
+// Product of two Q5.26 values in Q15.16, for results beyond the Q5.26 range
+inline int32_t fx_mul_to_out(fx_t a, fx_t b) {
+    return (int32_t) (((int64_t) a * b) >> (2 * FX_FRAC_BITS - FX_OUT_FRAC_BITS));
+}
+
+// Integer square root of a 64-bit value (bit-by-bit, no division)
+inline uint32_t fx_isqrt64(uint64_t v) {
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) res;
+}
+
+inline fx_t fx_sqrt(fx_t x) {
+    return x > 0 ? (fx_t) fx_isqrt64((uint64_t) x << FX_FRAC_BITS) : 0;
+}
+
+// Scale the n-vector v (any Q format, same for all components) to a unit vector in Q5.26.
+// `out` may alias `v`. Returns false and leaves `out` untouched when v is zero.
+// The components and the norm are shifted alike until the norm is in [1, 2) in Q5.26, so one division gives a
+// reciprocal in (0.5, 1] and each component costs one fx_mul().
+inline bool fx_normalize(const int32_t* v, fx_t* out, int n) {
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += (uint64_t) ((int64_t) v[i] * v[i]);
+    }
+    uint32_t norm = fx_isqrt64(sum);
+    if (norm == 0) {
+        return false;
+    }
+    int right = 0, left = 0;
+    while ((norm >> right) >= 2u * FX_ONE) {
+        right++;
+    }
+    while (((uint64_t) norm << left) < (uint64_t) FX_ONE) {
+        left++;
+    }
+    uint32_t scaled = (uint32_t) (((uint64_t) norm << left) >> right);
+    fx_t inverse = (fx_t) ((((uint64_t) 1 << (2 * FX_FRAC_BITS)) + scaled / 2) / scaled);
+    for (int i = 0; i < n; i++) {
+        out[i] = fx_mul((fx_t) (((int64_t) v[i] << left) >> right), inverse);
+    }
+    return true;
+}
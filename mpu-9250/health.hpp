@@ -0,0 +1,267 @@
+#pragma once
+
+#include "mbed.h"
+#include <math.h>
+#include "mpu-9250/MPU9250.hpp"
+
+// Health flags of a sample, returned by HealthMonitor::update()
+enum HealthFlag {
+    HEALTH_SELF_TEST_RUNNING    = 1 << 0,   // accel/gyro values of this sample are self-test output, do not use them
+    HEALTH_SELF_TEST_FAILED     = 1 << 1,   // last self-test response off the factory trim by more than 14 %
+    HEALTH_ACCEL_STUCK          = 1 << 2,   // an axis has not changed for HEALTH_STUCK_SAMPLES samples
+    HEALTH_GYRO_STUCK           = 1 << 3,
+    HEALTH_MAG_STUCK            = 1 << 4,
+    HEALTH_ACCEL_SATURATED      = 1 << 5,   // an axis is at the end of the full scale range in this sample
+    HEALTH_GYRO_SATURATED       = 1 << 6,
+    HEALTH_MAG_OVERFLOW         = 1 << 7    // the AK8963 reported a magnetic sensor overflow (ST2 HOFL) since the last sample
+};
+
+#define HEALTH_STUCK_SAMPLES        100
+#define HEALTH_SELF_TEST_AVERAGE_MS 100     // window averaged with and without self-test excitation
+#define HEALTH_SELF_TEST_SETTLE_MS  25      // samples dropped after each configuration change, 20 ms needed
+#define HEALTH_SELF_TEST_LIMIT      14.0f   // largest accepted deviation from the factory trim in %
+#define HEALTH_SELF_TEST_STILL_LSB  200     // largest gyro change in the reference window (1.5 dps), else retry
+
+struct HealthStatus {
+    uint16_t flags;                 // HealthFlag of the last sample
+    float selfTest[6];              // deviation of the accel x/y/z and gyro x/y/z self-test response from factory trim (%)
+    uint32_t selfTests;             // completed self-tests
+    uint32_t selfTestsAborted;      // self-tests dropped because the sensor moved
+    uint32_t accelSaturated;        // samples with a saturated accel axis
+    uint32_t gyroSaturated;
+    uint32_t magOverflows;
+};
+
+// Health check running alongside the sample stream.
+//
+// update() is called once per sample after the sample has been read. It checks the raw values for stuck and saturated
+// axes and counts AK8963 overflows. The accelerometer and gyro self-test runs as a state machine over the following
+// samples instead of blocking: it switches to 2 g / 250 dps, averages the output without and with self-test excitation
+// and restores the configuration, one register burst per step. The steps are timed with _timer rather than counted in
+// calls, since a fast loop may call update() several times per sample; a re-read sample only adds to the average
+// again. This takes a window of about 275 ms in which the samples are flagged HEALTH_SELF_TEST_RUNNING.
+class HealthMonitor {
+    enum State {
+        STATE_IDLE,
+        STATE_SETTLE_REFERENCE,
+        STATE_REFERENCE,
+        STATE_SETTLE_EXCITED,
+        STATE_EXCITED,
+        STATE_SETTLE_RESTORED
+    };
+
+    MPU9250* _sensor;
+    HealthStatus _status;
+    int16_t _last[9];
+    uint16_t _unchanged[9];
+    uint32_t _magOverflowsSeen;
+    uint16_t _stickyFlags = 0;
+
+    State _state = STATE_IDLE;
+    uint32_t _stateStart = 0;       // _timer.read_ms() at the last state change
+    uint16_t _count = 0;            // samples in _sum
+    int32_t _sum[6];
+    int32_t _reference[6];
+    uint16_t _referenceCount = 0;
+    int16_t _gyroMin[3], _gyroMax[3];
+    uint8_t _codes[6];              // factory self-test codes, accel x/y/z and gyro x/y/z
+    bool _codesRead = false;
+    bool _requested = false;
+    Timer _timer;
+    uint32_t _intervalMs;
+
+    void configure(uint8_t accelConfig, uint8_t gyroConfig) {
+        const RegisterSetting config[] = {
+            {GYRO_CONFIG,  0xF8, gyroConfig},
+            {ACCEL_CONFIG, 0xF8, accelConfig},
+        };
+        _sensor->applyConfig(config, 2);
+    }
+
+    void startSelfTest(void) {
+        if (!_codesRead) {
+            _sensor->readBytes(_sensor->getAddress(), SELF_TEST_X_ACCEL, 3, &_codes[0]);
+            _sensor->readBytes(_sensor->getAddress(), SELF_TEST_X_GYRO, 3, &_codes[3]);
+            _codesRead = true;
+        }
+        configure(AFS_2G << 3, GFS_250DPS << 3);
+        _requested = false;
+        _timer.reset();
+        setState(STATE_SETTLE_REFERENCE);
+    }
+
+    void setState(State state) {
+        _state = state;
+        _stateStart = _timer.read_ms();
+    }
+
+    bool stateElapsed(uint32_t ms) {
+        return (uint32_t) _timer.read_ms() - _stateStart >= ms;
+    }
+
+    void finishSelfTest(void) {
+        bool failed = false;
+        for (int i = 0; i < 6; i++) {
+            float response = (float) _sum[i] / _count - (float) _reference[i] / _referenceCount;
+            // Factory trim at the lowest full scale (see MPU9250SelfTest())
+            float trim = 2620.0f * powf(1.01f, (float) _codes[i] - 1.0f);
+            _status.selfTest[i] = _codes[i] ? 100.0f * response / trim - 100.0f : 0.0f;
+            failed |= fabsf(_status.selfTest[i]) > HEALTH_SELF_TEST_LIMIT;
+        }
+        _stickyFlags = failed ? (_stickyFlags | HEALTH_SELF_TEST_FAILED) : (_stickyFlags & ~HEALTH_SELF_TEST_FAILED);
+        _status.selfTests++;
+    }
+
+    // One step of the self-test per update() call; `raw` is accel x/y/z, gyro x/y/z
+    void stepSelfTest(const int16_t* raw) {
+        switch (_state) {
+            case STATE_IDLE:
+                return;
+            case STATE_SETTLE_REFERENCE:
+            case STATE_SETTLE_EXCITED:
+                if (!stateElapsed(HEALTH_SELF_TEST_SETTLE_MS)) {
+                    return;
+                }
+                memset(_sum, 0, sizeof(_sum));
+                _count = 0;
+                for (int i = 0; i < 3; i++) {
+                    _gyroMin[i] = _gyroMax[i] = raw[3 + i];
+                }
+                setState(_state == STATE_SETTLE_REFERENCE ? STATE_REFERENCE : STATE_EXCITED);
+                return;
+            case STATE_REFERENCE:
+            case STATE_EXCITED:
+                for (int i = 0; i < 6; i++) {
+                    _sum[i] += raw[i];
+                }
+                for (int i = 0; i < 3; i++) {
+                    _gyroMin[i] = raw[3 + i] < _gyroMin[i] ? raw[3 + i] : _gyroMin[i];
+                    _gyroMax[i] = raw[3 + i] > _gyroMax[i] ? raw[3 + i] : _gyroMax[i];
+                }
+                _count++;
+                if (!stateElapsed(HEALTH_SELF_TEST_AVERAGE_MS)) {
+                    return;
+                }
+                if (_state == STATE_REFERENCE) {
+                    bool still = true;
+                    for (int i = 0; i < 3; i++) {
+                        still &= _gyroMax[i] - _gyroMin[i] <= HEALTH_SELF_TEST_STILL_LSB;
+                    }
+                    if (!still) {
+                        // Motion would be taken for the self-test response; try again at the next interval
+                        _status.selfTestsAborted++;
+                        configure(_sensor->getAccelScale() << 3, _sensor->getGyroScale() << 3);
+                        setState(STATE_SETTLE_RESTORED);
+                        return;
+                    }
+                    memcpy(_reference, _sum, sizeof(_reference));
+                    _referenceCount = _count;
+                    configure(0xE0 | AFS_2G << 3, 0xE0 | GFS_250DPS << 3); // Self-test on all axes
+                    setState(STATE_SETTLE_EXCITED);
+                } else {
+                    finishSelfTest();
+                    configure(_sensor->getAccelScale() << 3, _sensor->getGyroScale() << 3);
+                    setState(STATE_SETTLE_RESTORED);
+                }
+                return;
+            case STATE_SETTLE_RESTORED:
+                if (!stateElapsed(HEALTH_SELF_TEST_SETTLE_MS)) {
+                    return;
+                }
+                _state = STATE_IDLE;
+                return;
+        }
+    }
+
+    // Stuck axes over the raw values of this sample
+    uint16_t checkStuck(const int16_t* raw) {
+        uint16_t flags = 0;
+        static const uint16_t stuckFlag[3] = {HEALTH_ACCEL_STUCK, HEALTH_GYRO_STUCK, HEALTH_MAG_STUCK};
+        for (int i = 0; i < 9; i++) {
+            if (raw[i] == _last[i]) {
+                if (_unchanged[i] < HEALTH_STUCK_SAMPLES) {
+                    _unchanged[i]++;
+                }
+            } else {
+                _unchanged[i] = 0;
+                _last[i] = raw[i];
+            }
+            if (_unchanged[i] >= HEALTH_STUCK_SAMPLES) {
+                flags |= stuckFlag[i / 3];
+            }
+        }
+        return flags;
+    }
+
+public:
+    /*
+     * selfTestIntervalMs ... period of the background self-test, 0 to run it on requestSelfTest() only
+     */
+    HealthMonitor(MPU9250* sensor, uint32_t selfTestIntervalMs = 0): _sensor(sensor), _intervalMs(selfTestIntervalMs) {
+        memset(&_status, 0, sizeof(_status));
+        memset(_last, 0, sizeof(_last));
+        memset(_unchanged, 0, sizeof(_unchanged));
+        _magOverflowsSeen = sensor->getMagOverflowCount();
+        _timer.start();
+    }
+
+    /* Run the self-test from the next sample on, e.g. in a scheduled maintenance window */
+    void requestSelfTest(void) {
+        _requested = true;
+    }
+
+    /*
+     * Check the sample just read (MPU9250::getLastRaw()) and advance the self-test. Returns the HealthFlag of the sample.
+     */
+    uint16_t update(void) {
+        int16_t raw[9];
+        _sensor->getLastRaw(raw);
+        uint16_t flags = 0;
+
+        bool selfTest = _state != STATE_IDLE;
+        if (selfTest) {
+            flags |= HEALTH_SELF_TEST_RUNNING;
+            stepSelfTest(raw);
+        } else {
+            // Saturation and stuck axes only apply to the normal configuration
+            for (int i = 0; i < 3; i++) {
+                if (raw[i] == INT16_MAX || raw[i] == INT16_MIN) {
+                    flags |= HEALTH_ACCEL_SATURATED;
+                }
+                if (raw[3 + i] == INT16_MAX || raw[3 + i] == INT16_MIN) {
+                    flags |= HEALTH_GYRO_SATURATED;
+                }
+            }
+            _status.accelSaturated += (flags & HEALTH_ACCEL_SATURATED) != 0;
+            _status.gyroSaturated += (flags & HEALTH_GYRO_SATURATED) != 0;
+            flags |= checkStuck(raw);
+            if (_requested || (_intervalMs && (uint32_t) _timer.read_ms() >= _intervalMs)) {
+                startSelfTest();
+            }
+        }
+
+        uint32_t overflows = _sensor->getMagOverflowCount();
+        if (overflows != _magOverflowsSeen) {
+            flags |= HEALTH_MAG_OVERFLOW;
+            _status.magOverflows += overflows - _magOverflowsSeen;
+            _magOverflowsSeen = overflows;
+        }
+
+        _status.flags = flags | _stickyFlags;
+        return _status.flags;
+    }
+
+    const HealthStatus& getStatus(void) {
+        return _status;
+    }
+
+    void print(void) {
+        printf("[HEALTH] flags: 0x%04X self-tests: %lu (aborted %lu) saturated accel: %lu gyro: %lu mag overflows: %lu\r\n",
+            _status.flags, (unsigned long) _status.selfTests, (unsigned long) _status.selfTestsAborted,
+            (unsigned long) _status.accelSaturated, (unsigned long) _status.gyroSaturated,
+            (unsigned long) _status.magOverflows);
+        printf("[HEALTH] self-test deviation (%%) accel x:%6.1f y:%6.1f z:%6.1f gyro x:%6.1f y:%6.1f z:%6.1f\r\n",
+            _status.selfTest[0], _status.selfTest[1], _status.selfTest[2],
+            _status.selfTest[3], _status.selfTest[4], _status.selfTest[5]);
+    }
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <new>
+#include "mbed.h"
+
+// Priority of a bus transaction. Sample reads use I2C_PRIORITY_HIGH, configuration and diagnostics I2C_PRIORITY_LOW.
+enum I2CBusPriority {
+    I2C_PRIORITY_LOW = 0,
+    I2C_PRIORITY_HIGH,
+    I2C_PRIORITY_COUNT
+};
+
+// Time spent waiting for the bus, per priority
+struct I2CBusStats {
+    uint32_t transactions[I2C_PRIORITY_COUNT];  // completed lock/unlock pairs
+    uint32_t contended[I2C_PRIORITY_COUNT];     // transactions that found the bus busy
+    uint32_t waitTotalUs[I2C_PRIORITY_COUNT];
+    uint32_t waitMaxUs[I2C_PRIORITY_COUNT];
+};
+
+// Free a bus whose SDA line is held low by a slave that lost track of a transaction (e.g. after a reset of the master
+// in the middle of a read): clock SCL until the slave releases SDA, then send a STOP. The pins are driven open drain
+// style, as input (released to the pull-up) or as output low. Returns true if SDA is high afterwards.
+inline bool i2c_bus_clear(PinName sda, PinName scl) {
+    DigitalInOut sdaPin(sda, PIN_INPUT, PullUp, 0);
+    DigitalInOut sclPin(scl, PIN_INPUT, PullUp, 0);
+    sdaPin.write(0);        // output level, applied by output()
+    sclPin.write(0);
+    for (int i = 0; i < 9 && sdaPin.read() == 0; i++) {
+        sclPin.output();    // low
+        wait_us(5);
+        sclPin.input();     // high
+        wait_us(5);
+    }
+    // STOP condition: SDA rises while SCL is high
+    sclPin.output();
+    wait_us(5);
+    sdaPin.output();
+    wait_us(5);
+    sclPin.input();
+    wait_us(5);
+    sdaPin.input();
+    wait_us(5);
+    return sdaPin.read() == 1;
+}
+
+// Shared I2C bus that serialises transactions from any number of threads.
+//
+// A transaction is everything between lock() and unlock(), e.g. the register address write and the repeated start
+// read of MPU9250::readBytes(). The bus cannot interrupt a transfer in progress, but a high priority transaction is
+// always granted before any pending low priority one: low priority callers back off while a high priority caller is
+// waiting, so an IMU sample read waits for at most one transaction in progress.
+// The bus is held by a binary semaphore rather than a mutex, so that an asynchronous transfer can release it from its
+// completion interrupt (unlock() is ISR safe; lock() is not).
+class I2CBus {
+    I2C _i2c;
+    PinName _sda, _scl;                 // kept for recover()
+    int _hz = 100000;
+    uint8_t _id;
+    uint32_t _recoveries = 0;
+    Semaphore _free;
+    volatile bool _held = false;        // the token of _free is taken; unlock() releases it only once
+    volatile uint32_t _highWaiting = 0;
+    I2CBusStats _stats;
+
+public:
+    /*
+     * id ... bus number reported to sensors (MPU9250::getBusId())
+     */
+    I2CBus(PinName sda, PinName scl, uint8_t id): _i2c(sda, scl), _sda(sda), _scl(scl), _id(id), _free(1) {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    I2C* getI2C(void) {
+        return &_i2c;
+    }
+
+    uint8_t getId(void) {
+        return _id;
+    }
+
+    void frequency(int hz) {
+        lock(I2C_PRIORITY_LOW);
+        _hz = hz;
+        _i2c.frequency(hz);
+        unlock();
+    }
+
+    /*
+     * Clear a stuck bus (see i2c_bus_clear()) and recreate the I2C peripheral, which also resets a controller left
+     * busy by the failed transaction. Returns false if SDA is still held low.
+     */
+    bool recover(void) {
+        lock(I2C_PRIORITY_HIGH);
+        _i2c.~I2C();
+        bool released = i2c_bus_clear(_sda, _scl);
+        new (&_i2c) I2C(_sda, _scl);
+        _i2c.frequency(_hz);
+        _recoveries++;
+        unlock();
+        return released;
+    }
+
+    uint32_t getRecoveryCount(void) {
+        return _recoveries;
+    }
+
+    void lock(I2CBusPriority priority) {
+        if (_free.wait(0) > 0) {
+            if (priority == I2C_PRIORITY_HIGH || _highWaiting == 0) {
+                _held = true;
+                _stats.transactions[priority]++;
+                return;
+            }
+            _free.release();
+        }
+
+        uint32_t start = us_ticker_read();
+        if (priority == I2C_PRIORITY_HIGH) {
+            core_util_critical_section_enter();
+            _highWaiting++;
+            core_util_critical_section_exit();
+            _free.wait();
+            core_util_critical_section_enter();
+            _highWaiting--;
+            core_util_critical_section_exit();
+        } else {
+            while (true) {
+                _free.wait();
+                if (_highWaiting == 0) {
+                    break;
+                }
+                _free.release();
+                Thread::yield(); // let the high priority waiter take the bus
+            }
+        }
+        _held = true;
+        uint32_t waited = us_ticker_read() - start;
+
+        // Statistics are only updated while holding the bus
+        _stats.transactions[priority]++;
+        _stats.contended[priority]++;
+        _stats.waitTotalUs[priority] += waited;
+        if (waited > _stats.waitMaxUs[priority]) {
+            _stats.waitMaxUs[priority] = waited;
+        }
+    }
+
+    /* ISR safe. A second unlock() of the same transaction does nothing, so the bus stays mutually exclusive. */
+    void unlock(void) {
+        core_util_critical_section_enter();
+        bool held = _held;
+        _held = false;
+        core_util_critical_section_exit();
+        if (held) {
+            _free.release();
+        }
+    }
+
+    /* Copy of the statistics taken while holding the bus */
+    void getStats(I2CBusStats* stats) {
+        _free.wait();
+        _held = true;
+        *stats = _stats;
+        unlock();
+    }
+
+    void resetStats(void) {
+        _free.wait();
+        _held = true;
+        memset(&_stats, 0, sizeof(_stats));
+        unlock();
+    }
+
+    void printStats(void) {
+        I2CBusStats stats;
+        getStats(&stats);
+        if (_recoveries) {
+            printf("[I2C%u] recoveries: %lu\r\n", _id, (unsigned long) _recoveries);
+        }
+        for (int p = I2C_PRIORITY_COUNT - 1; p >= 0; p--) {
+            printf("[I2C%u %s] transactions: %lu contended: %lu wait: %lu us total %lu us max\r\n",
+                _id, p == I2C_PRIORITY_HIGH ? "HIGH" : "LOW ",
+                (unsigned long) stats.transactions[p], (unsigned long) stats.contended[p],
+                (unsigned long) stats.waitTotalUs[p], (unsigned long) stats.waitMaxUs[p]);
+        }
+    }
+};
+
+// Holds a bus for the lifetime of the object; does nothing without a bus
+class I2CBusLock {
+    I2CBus* _bus;
+
+public:
+    I2CBusLock(I2CBus* bus, I2CBusPriority priority): _bus(bus) {
+        if (_bus) {
+            _bus->lock(priority);
+        }
+    }
+
+    ~I2CBusLock() {
+        if (_bus) {
+            _bus->unlock();
+        }
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "mbed.h"
+
+// Register I/O instrumentation, enabled by building with MPU9250_I2C_STATS=1.
+//
+// Every transaction of MPU9250::writeByte(), readByte(), readBytes() and the asynchronous sample transfer is recorded
+// per register, identified by device address, first register and direction. Registers accessed from several places
+// (e.g. INT_STATUS, PWR_MGMT_1, USER_CTRL, ACCEL_CONFIG2) share one entry. An entry keeps the transaction, byte and
+// error (NACK or bus error) counts and a log2 histogram of the transaction latency, including the time spent waiting
+// for a shared I2CBus.
+// When disabled, i2c_stats_start() and the i2c_stats_record functions are empty inline functions and no table is
+// allocated.
+#ifndef MPU9250_I2C_STATS
+#define MPU9250_I2C_STATS 0
+#endif
+
+#define I2C_STATS_MAX_SITES     24
+#define I2C_STATS_BUCKETS       16      // bucket k counts latencies of [2^(k-1), 2^k) us, bucket 0 below 1 us
+
+enum I2CStatsOp {
+    I2C_STATS_WRITE = 0,
+    I2C_STATS_READ
+};
+
+struct I2CSiteStats {
+    uint8_t address;                    // 8-bit device address
+    uint8_t reg;                        // first register of the transaction
+    uint8_t op;                         // I2CStatsOp
+    uint32_t transactions;
+    uint32_t bytes;                     // register data bytes, without the device and register address
+    uint32_t errors;
+    uint32_t totalUs;
+    uint32_t maxUs;
+    uint32_t histogram[I2C_STATS_BUCKETS];
+};
+
+// Plain copy of the statistics, e.g. to print or to send over a link
+struct I2CStatsSnapshot {
+    uint8_t count;                      // used entries of sites[]
+    uint32_t dropped;                   // transactions of registers that did not fit into the table
+    I2CSiteStats sites[I2C_STATS_MAX_SITES];
+};
+
+inline uint8_t i2c_stats_bucket(uint32_t us) {
+    uint8_t bucket = 0;
+    while (us && bucket < I2C_STATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+#if MPU9250_I2C_STATS
+inline I2CStatsSnapshot& i2c_stats_table(void) {
+    static I2CStatsSnapshot table;
+    return table;
+}
+
+inline uint32_t i2c_stats_start(void) {
+    return us_ticker_read();
+}
+
+/*
+ * elapsed ... transaction latency in us
+ * status ... return code of the I2C call, non-zero on NACK or bus error
+ */
+inline void i2c_stats_record_us(uint8_t address, uint8_t reg, I2CStatsOp op, uint32_t bytes, uint32_t elapsed, int status) {
+    I2CStatsSnapshot& table = i2c_stats_table();
+
+    // Registers on different buses are recorded from different threads
+    core_util_critical_section_enter();
+    I2CSiteStats* site = NULL;
+    for (uint8_t i = 0; i < table.count; i++) {
+        I2CSiteStats* s = &table.sites[i];
+        if (s->reg == reg && s->address == address && s->op == op) {
+            site = s;
+            break;
+        }
+    }
+    if (!site && table.count < I2C_STATS_MAX_SITES) {
+        site = &table.sites[table.count++];
+        memset(site, 0, sizeof(*site));
+        site->address = address;
+        site->reg = reg;
+        site->op = op;
+    }
+    if (site) {
+        site->transactions++;
+        site->bytes += bytes;
+        site->errors += status != 0;
+        site->totalUs += elapsed;
+        if (elapsed > site->maxUs) {
+            site->maxUs = elapsed;
+        }
+        site->histogram[i2c_stats_bucket(elapsed)]++;
+    } else {
+        table.dropped++;
+    }
+    core_util_critical_section_exit();
+}
+
+/*
+ * start ... i2c_stats_start() taken before the transaction
+ */
+inline void i2c_stats_record(uint8_t address, uint8_t reg, I2CStatsOp op, uint32_t bytes, uint32_t start, int status) {
+    i2c_stats_record_us(address, reg, op, bytes, us_ticker_read() - start, status);
+}
+
+inline void i2c_stats_snapshot(I2CStatsSnapshot* snapshot) {
+    core_util_critical_section_enter();
+    *snapshot = i2c_stats_table();
+    core_util_critical_section_exit();
+}
+
+inline void i2c_stats_reset(void) {
+    core_util_critical_section_enter();
+    i2c_stats_table().count = 0;
+    i2c_stats_table().dropped = 0;
+    core_util_critical_section_exit();
+}
+
+inline void i2c_stats_print(const I2CStatsSnapshot& snapshot) {
+    for (uint8_t i = 0; i < snapshot.count; i++) {
+        const I2CSiteStats& s = snapshot.sites[i];
+        printf("[I2C-IO] 0x%02X %s 0x%02X n: %lu bytes: %lu errors: %lu avg: %lu us max: %lu us |",
+            s.address >> 1, s.op == I2C_STATS_READ ? "R" : "W", s.reg,
+            (unsigned long) s.transactions, (unsigned long) s.bytes, (unsigned long) s.errors,
+            (unsigned long) (s.transactions ? s.totalUs / s.transactions : 0), (unsigned long) s.maxUs);
+        uint8_t last = I2C_STATS_BUCKETS;
+        while (last > 0 && s.histogram[last - 1] == 0) {
+            last--;
+        }
+        for (uint8_t b = 0; b < last; b++) {
+            printf(" %lu", (unsigned long) s.histogram[b]);
+        }
+        printf("\r\n");
+    }
+    if (snapshot.dropped) {
+        printf("[I2C-IO] %lu transactions of unlisted registers\r\n", (unsigned long) snapshot.dropped);
+    }
+}
+#else
+inline uint32_t i2c_stats_start(void) {
+    return 0;
+}
+
+inline void i2c_stats_record_us(uint8_t, uint8_t, I2CStatsOp, uint32_t, uint32_t, int) {
+}
+
+inline void i2c_stats_record(uint8_t, uint8_t, I2CStatsOp, uint32_t, uint32_t, int) {
+}
+#endif
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "mbed.h"
+
+// Acquisition loop timing, enabled by building with MPU9250_LOOP_MONITOR=1.
+//
+// An iteration runs from begin() to end(). mark() closes the current stage and adds the time since the previous
+// begin()/mark() to it, so stages may alternate (e.g. read accel/gyro, print, read mag) and are summed per iteration.
+// Against the sensor data-ready period the monitor tracks:
+//   - start interval and jitter (peak-to-peak variation of the interval between two begin() calls)
+//   - missed periods: data-ready periods that passed between two iterations without being read
+//   - overruns: iterations whose work time exceeded the period
+//   - latency: time from the end of the first read stage (sample taken) to end()
+// When disabled, LoopMonitor is an empty class with the same interface.
+#ifndef MPU9250_LOOP_MONITOR
+#define MPU9250_LOOP_MONITOR 0
+#endif
+
+enum LoopStage {
+    LOOP_STAGE_READ = 0,
+    LOOP_STAGE_CONVERT,
+    LOOP_STAGE_FUSE,
+    LOOP_STAGE_OUTPUT,
+    LOOP_STAGE_COUNT
+};
+
+struct LoopStageStats {
+    uint32_t lastUs;                    // time of the stage in the last iteration
+    uint32_t maxUs;
+    uint32_t totalUs;
+};
+
+// All times in microseconds
+struct LoopStats {
+    uint32_t periodUs;                  // data-ready period the loop must keep up with
+    uint32_t iterations;
+    uint32_t intervalLastUs;            // between the last two begin() calls
+    uint32_t intervalMinUs;
+    uint32_t intervalMaxUs;
+    uint32_t workLastUs;                // begin() to end()
+    uint32_t workMaxUs;
+    uint32_t latencyLastUs;             // end of the first read stage to end()
+    uint32_t latencyMaxUs;
+    uint32_t missedPeriods;
+    uint32_t overruns;
+    LoopStageStats stages[LOOP_STAGE_COUNT];
+};
+
+#if MPU9250_LOOP_MONITOR
+class LoopMonitor {
+    LoopStats _stats;
+    uint32_t _begin = 0;
+    uint32_t _mark = 0;
+    uint32_t _sampled = 0;              // end of the first read stage of the iteration
+    bool _started = false;              // a previous begin() exists
+    bool _sampleTaken = false;
+    uint32_t _stageUs[LOOP_STAGE_COUNT];
+
+public:
+    /*
+     * periodUs ... sensor data-ready period, 1000000 / ODR
+     */
+    LoopMonitor(uint32_t periodUs) {
+        memset(&_stats, 0, sizeof(_stats));
+        _stats.periodUs = periodUs;
+        reset();
+    }
+
+    void begin(void) {
+        uint32_t now = us_ticker_read();
+        if (_started) {
+            uint32_t interval = now - _begin;
+            _stats.intervalLastUs = interval;
+            if (interval < _stats.intervalMinUs) {
+                _stats.intervalMinUs = interval;
+            }
+            if (interval > _stats.intervalMaxUs) {
+                _stats.intervalMaxUs = interval;
+            }
+            if (interval >= 2 * _stats.periodUs) {
+                _stats.missedPeriods += interval / _stats.periodUs - 1;
+            }
+        }
+        _started = true;
+        _begin = _mark = now;
+        _sampleTaken = false;
+        memset(_stageUs, 0, sizeof(_stageUs));
+    }
+
+    void mark(LoopStage stage) {
+        uint32_t now = us_ticker_read();
+        _stageUs[stage] += now - _mark;
+        _mark = now;
+        if (stage == LOOP_STAGE_READ && !_sampleTaken) {
+            _sampled = now;
+            _sampleTaken = true;
+        }
+    }
+
+    void end(void) {
+        uint32_t now = us_ticker_read();
+        _stats.iterations++;
+        _stats.workLastUs = now - _begin;
+        if (_stats.workLastUs > _stats.workMaxUs) {
+            _stats.workMaxUs = _stats.workLastUs;
+        }
+        if (_stats.workLastUs > _stats.periodUs) {
+            _stats.overruns++;
+        }
+        if (_sampleTaken) {
+            _stats.latencyLastUs = now - _sampled;
+            if (_stats.latencyLastUs > _stats.latencyMaxUs) {
+                _stats.latencyMaxUs = _stats.latencyLastUs;
+            }
+        }
+        for (int i = 0; i < LOOP_STAGE_COUNT; i++) {
+            LoopStageStats* s = &_stats.stages[i];
+            s->lastUs = _stageUs[i];
+            s->totalUs += _stageUs[i];
+            if (_stageUs[i] > s->maxUs) {
+                s->maxUs = _stageUs[i];
+            }
+        }
+    }
+
+    /* New data-ready period, e.g. after a change of the sample rate; the interval across the change is not measured */
+    void setPeriod(uint32_t periodUs) {
+        _stats.periodUs = periodUs;
+        skipInterval();
+    }
+
+    /* Do not measure the interval up to the next begin(), e.g. when the loop slept in low power */
+    void skipInterval(void) {
+        _started = false;
+    }
+
+    const LoopStats& getStats(void) {
+        return _stats;
+    }
+
+    /* Clear the statistics; the next interval is still measured from the last begin() */
+    void reset(void) {
+        uint32_t period = _stats.periodUs;
+        memset(&_stats, 0, sizeof(_stats));
+        _stats.periodUs = period;
+        _stats.intervalMinUs = 0xFFFFFFFF;
+    }
+
+    void print(void) {
+        static const char* names[LOOP_STAGE_COUNT] = {"read", "convert", "fuse", "output"};
+        uint32_t n = _stats.iterations ? _stats.iterations : 1;
+        uint32_t intervalMin = _stats.intervalMinUs == 0xFFFFFFFF ? 0 : _stats.intervalMinUs;
+        printf("[LOOP] period: %lu us iterations: %lu interval: %lu..%lu us jitter: %lu us missed periods: %lu overruns: %lu\r\n",
+            (unsigned long) _stats.periodUs, (unsigned long) _stats.iterations,
+            (unsigned long) intervalMin, (unsigned long) _stats.intervalMaxUs,
+            (unsigned long) (_stats.intervalMaxUs - intervalMin),
+            (unsigned long) _stats.missedPeriods, (unsigned long) _stats.overruns);
+        printf("[LOOP] work: %lu us (max %lu us) latency: %lu us (max %lu us)\r\n",
+            (unsigned long) _stats.workLastUs, (unsigned long) _stats.workMaxUs,
+            (unsigned long) _stats.latencyLastUs, (unsigned long) _stats.latencyMaxUs);
+        for (int i = 0; i < LOOP_STAGE_COUNT; i++) {
+            const LoopStageStats& s = _stats.stages[i];
+            printf("[LOOP] %-7s avg: %lu us max: %lu us\r\n", names[i],
+                (unsigned long) (s.totalUs / n), (unsigned long) s.maxUs);
+        }
+    }
+};
+#else
+class LoopMonitor {
+public:
+    LoopMonitor(uint32_t) {
+    }
+
+    void begin(void) {
+    }
+
+    void mark(LoopStage) {
+    }
+
+    void end(void) {
+    }
+
+    void setPeriod(uint32_t) {
+    }
+
+    void skipInterval(void) {
+    }
+};
+#endif
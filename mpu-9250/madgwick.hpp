@@ -0,0 +1,357 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include "mpu-9250/MPU9250-common.hpp"
+#include "mpu-9250/fixed_point.hpp"
+
+// Madgwick orientation filter kernels shared by MPU9250 and the batch/offline paths.
+// This header does not depend on mbed so that it can be built on the host.
+
+// Implementation of Sebastian Madgwick's "...efficient orientation filter for... inertial/magnetic sensor arrays"
+// (see http://www.x-io.co.uk/category/open-source/ for examples and more details)
+// which fuses acceleration, rotation rate, and magnetic moments to produce a quaternion-based estimate of absolute
+// device orientation -- which can be converted to yaw, pitch, and roll. Useful for stabilizing quadcopters, etc.
+// The performance of the orientation filter is at least as good as conventional Kalman-based filtering algorithms
+// but is much less computationally intensive---it can be performed on a 3.3 V Pro Mini operating at 8 MHz!
+inline void MadgwickQuaternionUpdate(float* q, float deltat, float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz)
+{
+    float q1 = q[0], q2 = q[1], q3 = q[2], q4 = q[3];     // short name local variable for readability
+    float norm;
+    float hx, hy, _2bx, _2bz;
+    float s1, s2, s3, s4;
+    float qDot1, qDot2, qDot3, qDot4;
+
+    // Auxiliary variables to avoid repeated arithmetic
+    float _2q1mx;
+    float _2q1my;
+    float _2q1mz;
+    float _2q2mx;
+    float _4bx;
+    float _4bz;
+    float _2q1 = 2.0f * q1;
+    float _2q2 = 2.0f * q2;
+    float _2q3 = 2.0f * q3;
+    float _2q4 = 2.0f * q4;
+    float _2q1q3 = 2.0f * q1 * q3;
+    float _2q3q4 = 2.0f * q3 * q4;
+    float q1q1 = q1 * q1;
+    float q1q2 = q1 * q2;
+    float q1q3 = q1 * q3;
+    float q1q4 = q1 * q4;
+    float q2q2 = q2 * q2;
+    float q2q3 = q2 * q3;
+    float q2q4 = q2 * q4;
+    float q3q3 = q3 * q3;
+    float q3q4 = q3 * q4;
+    float q4q4 = q4 * q4;
+
+    // Normalise accelerometer measurement
+    norm = sqrt(ax * ax + ay * ay + az * az);
+    if (norm == 0.0f) return; // handle NaN
+    norm = 1.0f/norm;
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+
+    // Normalise magnetometer measurement
+    norm = sqrt(mx * mx + my * my + mz * mz);
+    if (norm == 0.0f) return; // handle NaN
+    norm = 1.0f/norm;
+    mx *= norm;
+    my *= norm;
+    mz *= norm;
+
+    // Reference direction of Earth's magnetic field
+    _2q1mx = 2.0f * q1 * mx;
+    _2q1my = 2.0f * q1 * my;
+    _2q1mz = 2.0f * q1 * mz;
+    _2q2mx = 2.0f * q2 * mx;
+    hx = mx * q1q1 - _2q1my * q4 + _2q1mz * q3 + mx * q2q2 + _2q2 * my * q3 + _2q2 * mz * q4 - mx * q3q3 - mx * q4q4;
+    hy = _2q1mx * q4 + my * q1q1 - _2q1mz * q2 + _2q2mx * q3 - my * q2q2 + my * q3q3 + _2q3 * mz * q4 - my * q4q4;
+    _2bx = sqrt(hx * hx + hy * hy);
+    _2bz = -_2q1mx * q3 + _2q1my * q2 + mz * q1q1 + _2q2mx * q4 - mz * q2q2 + _2q3 * my * q4 - mz * q3q3 + mz * q4q4;
+    _4bx = 2.0f * _2bx;
+    _4bz = 2.0f * _2bz;
+
+    // Gradient decent algorithm corrective step
+    s1 = -_2q3 * (2.0f * q2q4 - _2q1q3 - ax) + _2q2 * (2.0f * q1q2 + _2q3q4 - ay) - _2bz * q3 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q4 + _2bz * q2) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q3 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
+    s2 = _2q4 * (2.0f * q2q4 - _2q1q3 - ax) + _2q1 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q2 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + _2bz * q4 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q3 + _2bz * q1) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q4 - _4bz * q2) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
+    s3 = -_2q1 * (2.0f * q2q4 - _2q1q3 - ax) + _2q4 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q3 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + (-_4bx * q3 - _2bz * q1) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q2 + _2bz * q4) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q1 - _4bz * q3) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
+    s4 = _2q2 * (2.0f * q2q4 - _2q1q3 - ax) + _2q3 * (2.0f * q1q2 + _2q3q4 - ay) + (-_4bx * q4 + _2bz * q2) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q1 + _2bz * q3) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q2 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
+    norm = sqrt(s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4);        // normalise step magnitude
+    norm = 1.0f/norm;
+    s1 *= norm;
+    s2 *= norm;
+    s3 *= norm;
+    s4 *= norm;
+
+    // Compute rate of change of quaternion
+    qDot1 = 0.5f * (-q2 * gx - q3 * gy - q4 * gz) - BETA * s1;
+    qDot2 = 0.5f * (q1 * gx + q3 * gz - q4 * gy) - BETA * s2;
+    qDot3 = 0.5f * (q1 * gy - q2 * gz + q4 * gx) - BETA * s3;
+    qDot4 = 0.5f * (q1 * gz + q2 * gy - q3 * gx) - BETA * s4;
+
+    // Integrate to yield quaternion
+    q1 += qDot1 * deltat;
+    q2 += qDot2 * deltat;
+    q3 += qDot3 * deltat;
+    q4 += qDot4 * deltat;
+    norm = sqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);        // normalise quaternion
+    norm = 1.0f/norm;
+    q[0] = q1 * norm;
+    q[1] = q2 * norm;
+    q[2] = q3 * norm;
+    q[3] = q4 * norm;
+}
+
+// Fixed-point version of MadgwickQuaternionUpdate() in Q5.26 (see fixed_point.hpp).
+// q is the Q5.26 quaternion (w, x, y, z), deltat the integration interval in Q5.26 seconds and gx, gy, gz rad/s in Q5.26.
+// Accel and mag are only used as directions, so they can be passed in any Q format as long as all three components of
+// a vector share it. Unlike the float version, a zero gradient leaves out the corrective step instead of producing NaN.
+const fx_t BETA_FX = fx_from_float(BETA);
+
+inline void MadgwickQuaternionUpdateFixed(fx_t* q, fx_t deltat, int32_t ax, int32_t ay, int32_t az, fx_t gx, fx_t gy, fx_t gz, int32_t mx, int32_t my, int32_t mz)
+{
+    fx_t q1 = q[0], q2 = q[1], q3 = q[2], q4 = q[3];
+    fx_t a[3] = {ax, ay, az};
+    fx_t m[3] = {mx, my, mz};
+    fx_t s[4];
+
+    // Normalise accelerometer and magnetometer measurements
+    if (!fx_normalize(a, a, 3) || !fx_normalize(m, m, 3)) {
+        return;
+    }
+    ax = a[0];
+    ay = a[1];
+    az = a[2];
+    mx = m[0];
+    my = m[1];
+    mz = m[2];
+
+    // Auxiliary variables to avoid repeated arithmetic
+    fx_t _2q1 = 2 * q1;
+    fx_t _2q2 = 2 * q2;
+    fx_t _2q3 = 2 * q3;
+    fx_t _2q4 = 2 * q4;
+    fx_t _2q1q3 = 2 * fx_mul(q1, q3);
+    fx_t _2q3q4 = 2 * fx_mul(q3, q4);
+    fx_t q1q1 = fx_mul(q1, q1);
+    fx_t q1q2 = fx_mul(q1, q2);
+    fx_t q1q3 = fx_mul(q1, q3);
+    fx_t q1q4 = fx_mul(q1, q4);
+    fx_t q2q2 = fx_mul(q2, q2);
+    fx_t q2q3 = fx_mul(q2, q3);
+    fx_t q2q4 = fx_mul(q2, q4);
+    fx_t q3q3 = fx_mul(q3, q3);
+    fx_t q3q4 = fx_mul(q3, q4);
+    fx_t q4q4 = fx_mul(q4, q4);
+    const fx_t half = FX_ONE / 2;
+
+    // Reference direction of Earth's magnetic field
+    fx_t _2q1mx = 2 * fx_mul(q1, mx);
+    fx_t _2q1my = 2 * fx_mul(q1, my);
+    fx_t _2q1mz = 2 * fx_mul(q1, mz);
+    fx_t _2q2mx = 2 * fx_mul(q2, mx);
+    fx_t hx = fx_mul(mx, q1q1) - fx_mul(_2q1my, q4) + fx_mul(_2q1mz, q3) + fx_mul(mx, q2q2) + fx_mul(fx_mul(_2q2, my), q3) + fx_mul(fx_mul(_2q2, mz), q4) - fx_mul(mx, q3q3) - fx_mul(mx, q4q4);
+    fx_t hy = fx_mul(_2q1mx, q4) + fx_mul(my, q1q1) - fx_mul(_2q1mz, q2) + fx_mul(_2q2mx, q3) - fx_mul(my, q2q2) + fx_mul(my, q3q3) + fx_mul(fx_mul(_2q3, mz), q4) - fx_mul(my, q4q4);
+    fx_t _2bx = fx_sqrt(fx_mul(hx, hx) + fx_mul(hy, hy));
+    fx_t _2bz = -fx_mul(_2q1mx, q3) + fx_mul(_2q1my, q2) + fx_mul(mz, q1q1) + fx_mul(_2q2mx, q4) - fx_mul(mz, q2q2) + fx_mul(fx_mul(_2q3, my), q4) - fx_mul(mz, q3q3) + fx_mul(mz, q4q4);
+    fx_t _4bx = 2 * _2bx;
+    fx_t _4bz = 2 * _2bz;
+
+    // Common error terms of the gradient
+    fx_t fa1 = 2 * q2q4 - _2q1q3 - ax;
+    fx_t fa2 = 2 * q1q2 + _2q3q4 - ay;
+    fx_t fa3 = FX_ONE - 2 * q2q2 - 2 * q3q3 - az;
+    fx_t fm1 = fx_mul(_2bx, half - q3q3 - q4q4) + fx_mul(_2bz, q2q4 - q1q3) - mx;
+    fx_t fm2 = fx_mul(_2bx, q2q3 - q1q4) + fx_mul(_2bz, q1q2 + q3q4) - my;
+    fx_t fm3 = fx_mul(_2bx, q1q3 + q2q4) + fx_mul(_2bz, half - q2q2 - q3q3) - mz;
+
+    // Gradient decent algorithm corrective step
+    s[0] = -fx_mul(_2q3, fa1) + fx_mul(_2q2, fa2) - fx_mul(fx_mul(_2bz, q3), fm1) + fx_mul(-fx_mul(_2bx, q4) + fx_mul(_2bz, q2), fm2) + fx_mul(fx_mul(_2bx, q3), fm3);
+    s[1] = fx_mul(_2q4, fa1) + fx_mul(_2q1, fa2) - fx_mul(4 * q2, fa3) + fx_mul(fx_mul(_2bz, q4), fm1) + fx_mul(fx_mul(_2bx, q3) + fx_mul(_2bz, q1), fm2) + fx_mul(fx_mul(_2bx, q4) - fx_mul(_4bz, q2), fm3);
+    s[2] = -fx_mul(_2q1, fa1) + fx_mul(_2q4, fa2) - fx_mul(4 * q3, fa3) + fx_mul(-fx_mul(_4bx, q3) - fx_mul(_2bz, q1), fm1) + fx_mul(fx_mul(_2bx, q2) + fx_mul(_2bz, q4), fm2) + fx_mul(fx_mul(_2bx, q1) - fx_mul(_4bz, q3), fm3);
+    s[3] = fx_mul(_2q2, fa1) + fx_mul(_2q3, fa2) + fx_mul(-fx_mul(_4bx, q4) + fx_mul(_2bz, q2), fm1) + fx_mul(-fx_mul(_2bx, q1) + fx_mul(_2bz, q3), fm2) + fx_mul(fx_mul(_2bx, q2), fm3);
+    if (!fx_normalize(s, s, 4)) {    // normalise step magnitude
+        s[0] = s[1] = s[2] = s[3] = 0;
+    }
+
+    // Compute rate of change of quaternion
+    fx_t qDot1 = ((-fx_mul(q2, gx) - fx_mul(q3, gy) - fx_mul(q4, gz)) >> 1) - fx_mul(BETA_FX, s[0]);
+    fx_t qDot2 = ((fx_mul(q1, gx) + fx_mul(q3, gz) - fx_mul(q4, gy)) >> 1) - fx_mul(BETA_FX, s[1]);
+    fx_t qDot3 = ((fx_mul(q1, gy) - fx_mul(q2, gz) + fx_mul(q4, gx)) >> 1) - fx_mul(BETA_FX, s[2]);
+    fx_t qDot4 = ((fx_mul(q1, gz) + fx_mul(q2, gy) - fx_mul(q3, gx)) >> 1) - fx_mul(BETA_FX, s[3]);
+
+    // Integrate to yield quaternion
+    fx_t n[4] = {
+        q1 + fx_mul(qDot1, deltat),
+        q2 + fx_mul(qDot2, deltat),
+        q3 + fx_mul(qDot3, deltat),
+        q4 + fx_mul(qDot4, deltat)
+    };
+    fx_normalize(n, q, 4);    // normalise quaternion
+}
+
+// Structure-of-arrays kernel advancing N independent Madgwick filters in lockstep, e.g. one per IMU of a multi-sensor
+// rig or a set of recordings replayed offline. It evaluates the same expressions as MadgwickQuaternionUpdate() for every
+// lane. The loop body has no early exit: a lane whose accel or mag vector is zero keeps its previous quaternion by a
+// select, so GCC vectorizes the loop with SSE/AVX on the host while on Cortex-M4 it remains a straight sequence of single
+// precision FPU operations.
+// Build flags matter: __builtin_sqrtf() is used because the profiles build with -fno-builtin, -fno-math-errno lets it
+// map to a vector sqrt or VSQRT.F32 instead of a libm call, and -fno-trapping-math lets GCC turn the selects into blends.
+// On the host use e.g. -O3 -mavx2 -fno-math-errno -fno-trapping-math.
+template <size_t N>
+struct MadgwickBatchInput {
+    alignas(32) float ax[N];    // accel, any unit (normalized inside)
+    alignas(32) float ay[N];
+    alignas(32) float az[N];
+    alignas(32) float gx[N];    // gyro (rad/s)
+    alignas(32) float gy[N];
+    alignas(32) float gz[N];
+    alignas(32) float mx[N];    // mag, any unit (normalized inside)
+    alignas(32) float my[N];
+    alignas(32) float mz[N];
+    alignas(32) float deltat[N];    // integration interval per filter (s)
+};
+
+template <size_t N>
+class MadgwickBatch {
+    alignas(32) float _q1[N];
+    alignas(32) float _q2[N];
+    alignas(32) float _q3[N];
+    alignas(32) float _q4[N];
+
+public:
+    MadgwickBatch() {
+        reset();
+    }
+
+    void reset(void) {
+        for (size_t i = 0; i < N; i++) {
+            _q1[i] = 1.0f;
+            _q2[i] = 0.0f;
+            _q3[i] = 0.0f;
+            _q4[i] = 0.0f;
+        }
+    }
+
+    /* float q[4], Quaternion (w, x, y, z) of filter `i` */
+    void getQuaternion(size_t i, float* q) const {
+        q[0] = _q1[i];
+        q[1] = _q2[i];
+        q[2] = _q3[i];
+        q[3] = _q4[i];
+    }
+
+    void setQuaternion(size_t i, const float* q) {
+        _q1[i] = q[0];
+        _q2[i] = q[1];
+        _q3[i] = q[2];
+        _q4[i] = q[3];
+    }
+
+    void update(const MadgwickBatchInput<N>& in) {
+        float* __restrict pq1 = _q1;
+        float* __restrict pq2 = _q2;
+        float* __restrict pq3 = _q3;
+        float* __restrict pq4 = _q4;
+        const float* __restrict pax = in.ax;
+        const float* __restrict pay = in.ay;
+        const float* __restrict paz = in.az;
+        const float* __restrict pgx = in.gx;
+        const float* __restrict pgy = in.gy;
+        const float* __restrict pgz = in.gz;
+        const float* __restrict pmx = in.mx;
+        const float* __restrict pmy = in.my;
+        const float* __restrict pmz = in.mz;
+        const float* __restrict pdt = in.deltat;
+
+        for (size_t i = 0; i < N; i++) {
+            float q1 = pq1[i], q2 = pq2[i], q3 = pq3[i], q4 = pq4[i];
+            float ax = pax[i], ay = pay[i], az = paz[i];
+            float gx = pgx[i], gy = pgy[i], gz = pgz[i];
+            float mx = pmx[i], my = pmy[i], mz = pmz[i];
+
+            // Lanes with a zero accel or mag vector keep their state (the scalar kernel returns early)
+            float an = ax * ax + ay * ay + az * az;
+            float mn = mx * mx + my * my + mz * mz;
+            bool valid = (an != 0.0f) & (mn != 0.0f);
+            an = valid ? an : 1.0f;
+            mn = valid ? mn : 1.0f;
+            float norm = 1.0f / __builtin_sqrtf(an);
+            ax *= norm;
+            ay *= norm;
+            az *= norm;
+            norm = 1.0f / __builtin_sqrtf(mn);
+            mx *= norm;
+            my *= norm;
+            mz *= norm;
+
+            float _2q1 = 2.0f * q1;
+            float _2q2 = 2.0f * q2;
+            float _2q3 = 2.0f * q3;
+            float _2q4 = 2.0f * q4;
+            float _2q1q3 = 2.0f * q1 * q3;
+            float _2q3q4 = 2.0f * q3 * q4;
+            float q1q1 = q1 * q1;
+            float q1q2 = q1 * q2;
+            float q1q3 = q1 * q3;
+            float q1q4 = q1 * q4;
+            float q2q2 = q2 * q2;
+            float q2q3 = q2 * q3;
+            float q2q4 = q2 * q4;
+            float q3q3 = q3 * q3;
+            float q3q4 = q3 * q4;
+            float q4q4 = q4 * q4;
+
+            // Reference direction of Earth's magnetic field
+            float _2q1mx = 2.0f * q1 * mx;
+            float _2q1my = 2.0f * q1 * my;
+            float _2q1mz = 2.0f * q1 * mz;
+            float _2q2mx = 2.0f * q2 * mx;
+            float hx = mx * q1q1 - _2q1my * q4 + _2q1mz * q3 + mx * q2q2 + _2q2 * my * q3 + _2q2 * mz * q4 - mx * q3q3 - mx * q4q4;
+            float hy = _2q1mx * q4 + my * q1q1 - _2q1mz * q2 + _2q2mx * q3 - my * q2q2 + my * q3q3 + _2q3 * mz * q4 - my * q4q4;
+            float _2bx = __builtin_sqrtf(hx * hx + hy * hy);
+            float _2bz = -_2q1mx * q3 + _2q1my * q2 + mz * q1q1 + _2q2mx * q4 - mz * q2q2 + _2q3 * my * q4 - mz * q3q3 + mz * q4q4;
+            float _4bx = 2.0f * _2bx;
+            float _4bz = 2.0f * _2bz;
+
+            // Common error terms of the gradient
+            float fa1 = 2.0f * q2q4 - _2q1q3 - ax;
+            float fa2 = 2.0f * q1q2 + _2q3q4 - ay;
+            float fa3 = 1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az;
+            float fm1 = _2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx;
+            float fm2 = _2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my;
+            float fm3 = _2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz;
+
+            // Gradient decent algorithm corrective step
+            float s1 = -_2q3 * fa1 + _2q2 * fa2 - _2bz * q3 * fm1 + (-_2bx * q4 + _2bz * q2) * fm2 + _2bx * q3 * fm3;
+            float s2 = _2q4 * fa1 + _2q1 * fa2 - 4.0f * q2 * fa3 + _2bz * q4 * fm1 + (_2bx * q3 + _2bz * q1) * fm2 + (_2bx * q4 - _4bz * q2) * fm3;
+            float s3 = -_2q1 * fa1 + _2q4 * fa2 - 4.0f * q3 * fa3 + (-_4bx * q3 - _2bz * q1) * fm1 + (_2bx * q2 + _2bz * q4) * fm2 + (_2bx * q1 - _4bz * q3) * fm3;
+            float s4 = _2q2 * fa1 + _2q3 * fa2 + (-_4bx * q4 + _2bz * q2) * fm1 + (-_2bx * q1 + _2bz * q3) * fm2 + _2bx * q2 * fm3;
+            norm = 1.0f / __builtin_sqrtf(s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4);    // normalise step magnitude
+            s1 *= norm;
+            s2 *= norm;
+            s3 *= norm;
+            s4 *= norm;
+
+            // Compute rate of change of quaternion and integrate
+            float deltat = pdt[i];
+            float n1 = q1 + (0.5f * (-q2 * gx - q3 * gy - q4 * gz) - BETA * s1) * deltat;
+            float n2 = q2 + (0.5f * (q1 * gx + q3 * gz - q4 * gy) - BETA * s2) * deltat;
+            float n3 = q3 + (0.5f * (q1 * gy - q2 * gz + q4 * gx) - BETA * s3) * deltat;
+            float n4 = q4 + (0.5f * (q1 * gz + q2 * gy - q3 * gx) - BETA * s4) * deltat;
+            norm = 1.0f / __builtin_sqrtf(n1 * n1 + n2 * n2 + n3 * n3 + n4 * n4);    // normalise quaternion
+            n1 *= norm;
+            n2 *= norm;
+            n3 *= norm;
+            n4 *= norm;
+
+            pq1[i] = valid ? n1 : q1;
+            pq2[i] = valid ? n2 : q2;
+            pq3[i] = valid ? n3 : q3;
+            pq4[i] = valid ? n4 : q4;
+        }
+    }
+};
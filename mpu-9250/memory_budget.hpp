@@ -0,0 +1,151 @@
+#pragma once
+
+#include "mbed.h"
+#include <new>
+#include <utility>
+
+// Build with MPU9250_STATIC_ALLOCATION=1 to place the sensor, the helper objects and every thread stack of the example
+// in static storage instead of the heap. The RAM use is then fixed at link time (see the map file and the [MEMORY]
+// report) and nothing can fail to allocate at run time.
+#ifndef MPU9250_STATIC_ALLOCATION
+#define MPU9250_STATIC_ALLOCATION 0
+#endif
+
+#ifndef MEMORY_BUDGET_MAX_ITEMS
+#define MEMORY_BUDGET_MAX_ITEMS 16
+#endif
+
+// One object created at run time, in static storage with MPU9250_STATIC_ALLOCATION=1 and on the heap otherwise.
+// create() may be called once.
+template <typename T>
+class StaticObject {
+#if MPU9250_STATIC_ALLOCATION
+    alignas(T) unsigned char _storage[sizeof(T)];
+#endif
+    T* _object = NULL;
+
+public:
+    template <typename... Args>
+    T* create(Args&&... args) {
+#if MPU9250_STATIC_ALLOCATION
+        _object = new (_storage) T(std::forward<Args>(args)...);
+#else
+        _object = new T(std::forward<Args>(args)...);
+#endif
+        return _object;
+    }
+
+    T* get(void) const {
+        return _object;
+    }
+};
+
+// Stack memory of a thread: a static array with MPU9250_STATIC_ALLOCATION=1, allocated by Thread otherwise
+template <uint32_t SIZE>
+class ThreadStack {
+#if MPU9250_STATIC_ALLOCATION
+    alignas(8) unsigned char _memory[SIZE];
+#endif
+
+public:
+    static const uint32_t size = SIZE;
+
+    unsigned char* get(void) {
+#if MPU9250_STATIC_ALLOCATION
+        return _memory;
+#else
+        return NULL;
+#endif
+    }
+};
+
+#if defined(TOOLCHAIN_GCC_ARM)
+// Section boundaries of the GCC_ARM linker scripts
+extern "C" uint32_t __data_start__, __data_end__, __bss_start__, __bss_end__;
+#endif
+
+// RAM budget of the application: the registered objects and stacks with their size and where they live, and the stack
+// high-water mark of the registered threads.
+//
+// Thread::max_stack() reports the deepest stack use since the thread started. It relies on the stack watermark of
+// RTX, enabled with "platform.stack-stats-enabled": true (MBED_STACK_STATS_ENABLED) in mbed_app.json; without it
+// the value may stay at the current use only.
+class MemoryBudget {
+    enum Kind {
+        KIND_STATIC,
+        KIND_HEAP,
+        KIND_THREAD
+    };
+
+    struct Item {
+        const char* name;
+        uint32_t size;
+        Kind kind;
+        Thread* thread;
+    };
+
+    Item _items[MEMORY_BUDGET_MAX_ITEMS];
+    uint8_t _count = 0;
+
+    void add(const char* name, uint32_t size, Kind kind, Thread* thread) {
+        if (_count < MEMORY_BUDGET_MAX_ITEMS) {
+            Item& item = _items[_count++];
+            item.name = name;
+            item.size = size;
+            item.kind = kind;
+            item.thread = thread;
+        }
+    }
+
+public:
+    /* Object or buffer of `size` bytes in static storage */
+    void addStatic(const char* name, uint32_t size) {
+        add(name, size, KIND_STATIC, NULL);
+    }
+
+    /* Object or buffer of `size` bytes allocated from the heap */
+    void addHeap(const char* name, uint32_t size) {
+        add(name, size, KIND_HEAP, NULL);
+    }
+
+    /* Object of a StaticObject, static or heap depending on MPU9250_STATIC_ALLOCATION */
+    void addObject(const char* name, uint32_t size) {
+        add(name, size, MPU9250_STATIC_ALLOCATION ? KIND_STATIC : KIND_HEAP, NULL);
+    }
+
+    /* Stack high-water mark of `thread`; its memory is accounted for by the object or stack holding it */
+    void addThread(const char* name, Thread* thread) {
+        add(name, 0, KIND_THREAD, thread);
+    }
+
+    void print(void) {
+        static const char* kinds[] = {"static", "heap", "stack"};
+        uint32_t total[2] = {0, 0};
+        for (uint8_t i = 0; i < _count; i++) {
+            const Item& item = _items[i];
+            if (item.kind == KIND_THREAD) {
+                uint32_t size = item.thread->stack_size();
+                uint32_t used = item.thread->max_stack();
+                printf("[MEMORY] %-6s %-12s %6lu bytes used of %6lu (%lu %%)\r\n", kinds[item.kind], item.name,
+                    (unsigned long) used, (unsigned long) size, (unsigned long) (size ? 100 * used / size : 0));
+            } else {
+                total[item.kind] += item.size;
+                printf("[MEMORY] %-6s %-12s %6lu bytes\r\n", kinds[item.kind], item.name, (unsigned long) item.size);
+            }
+        }
+        printf("[MEMORY] total  static: %lu bytes heap: %lu bytes\r\n", (unsigned long) total[KIND_STATIC],
+            (unsigned long) total[KIND_HEAP]);
+#if defined(TOOLCHAIN_GCC_ARM)
+        printf("[MEMORY] image  .data: %lu bytes .bss: %lu bytes\r\n",
+            (unsigned long) ((uint8_t*) &__data_end__ - (uint8_t*) &__data_start__),
+            (unsigned long) ((uint8_t*) &__bss_end__ - (uint8_t*) &__bss_start__));
+#endif
+#if MBED_HEAP_STATS_ENABLED
+        mbed_stats_heap_t heap;
+        mbed_stats_heap_get(&heap);
+        printf("[MEMORY] heap   in use: %lu bytes max: %lu bytes allocations: %lu failed: %lu\r\n",
+            (unsigned long) heap.current_size, (unsigned long) heap.max_size, (unsigned long) heap.total_alloc_cnt,
+            (unsigned long) heap.alloc_fail_cnt);
+#endif
+    }
+};
@@ -2,7 +2,174 @@
 
 #include "mbed.h"
 #include "mpu-9250/MPU9250.hpp"
+#include "mpu-9250/sample_hub.hpp"
+#include "mpu-9250/memory_budget.hpp"
+
+// Stream raw frames as compressed blocks (see sample_codec.hpp and tools/sample_decode.cpp)
+// instead of the human-readable output
+#ifndef MPU9250_LOG_COMPRESSED
+#define MPU9250_LOG_COMPRESSED 0
+#endif
+
+// Bytes of a compressed block written per loop iteration, 2 ms at 115200 baud, so that the loop still checks the
+// data-ready flag within every 5 ms sample period
+#ifndef MPU9250_LOG_CHUNK
+#define MPU9250_LOG_CHUNK 24
+#endif
+
+// Print the human-readable output with printf() instead of the fixed-width formatter (mpu-9250/text_format.hpp),
+// e.g. to compare both
+#ifndef MPU9250_PRINTF_OUTPUT
+#define MPU9250_PRINTF_OUTPUT 0
+#endif
+
+// Read accel/gyro with interrupt driven I2C::transfer() calls, overlapping the bus transfer of the next sample with
+// the processing of the current one (needs DEVICE_I2C_ASYNCH). Printed samples are one period late.
+#ifndef MPU9250_ASYNC_I2C
+#define MPU9250_ASYNC_I2C 0
+#endif
+
+#if MPU9250_ASYNC_I2C && !DEVICE_I2C_ASYNCH
+#error "MPU9250_ASYNC_I2C requires a target with DEVICE_I2C_ASYNCH"
+#endif
+
+// Enter the wake-on-motion low-power mode after MPU9250_IDLE_TIMEOUT_MS without motion and resume full-rate
+// acquisition on the motion interrupt. Needs the MPU9250 INT pin wired to MPU9250_INT_PIN.
+#ifndef MPU9250_WAKE_ON_MOTION
+#define MPU9250_WAKE_ON_MOTION 0
+#endif
+
+#ifndef MPU9250_INT_PIN
+#define MPU9250_INT_PIN D7
+#endif
+
+#ifndef MPU9250_IDLE_TIMEOUT_MS
+#define MPU9250_IDLE_TIMEOUT_MS 30000
+#endif
+
+// Attach health flags (mpu-9250/health.hpp) to every sample and run the accel/gyro self-test in the background every
+// MPU9250_SELF_TEST_INTERVAL_MS
+#ifndef MPU9250_HEALTH_CHECK
+#define MPU9250_HEALTH_CHECK 0
+#endif
+
+#ifndef MPU9250_SELF_TEST_INTERVAL_MS
+#define MPU9250_SELF_TEST_INTERVAL_MS 600000
+#endif
+
+// Compensate the gyro and accel biases over temperature with a table learned while the sensor is at rest
+// (mpu-9250/bias_table.hpp). On targets with DEVICE_FLASH the table is loaded at start and saved every
+// MPU9250_BIAS_SAVE_INTERVAL_MS while it changes, by a low-priority thread, or when the sensor enters low power with
+// MPU9250_WAKE_ON_MOTION.
+#ifndef MPU9250_TEMP_COMPENSATION
+#define MPU9250_TEMP_COMPENSATION 0
+#endif
+
+#ifndef MPU9250_BIAS_SAVE_INTERVAL_MS
+#define MPU9250_BIAS_SAVE_INTERVAL_MS 600000
+#endif
+
+#ifndef MPU9250_BIAS_SAVE_STACK_SIZE
+#define MPU9250_BIAS_SAVE_STACK_SIZE 1024
+#endif
+
+// Stream the accelerometer through the FIFO at 4 kHz and compute its vibration spectrum (mpu-9250/vibration.hpp) in a
+// low-priority thread, printed every MPU9250_VIBRATION_REPORT_BLOCKS blocks
+#ifndef MPU9250_VIBRATION
+#define MPU9250_VIBRATION 0
+#endif
+
+#ifndef MPU9250_VIBRATION_AXIS
+#define MPU9250_VIBRATION_AXIS 2
+#endif
+
+#ifndef MPU9250_VIBRATION_REPORT_BLOCKS
+#define MPU9250_VIBRATION_REPORT_BLOCKS 16
+#endif
+
+// Print the text output of every MPU9250_OUTPUT_DIVIDER-th sample only. In the vibration build the loop must drain the
+// FIFO every 20 ms, while the text of one sample takes about 26 ms at 115200 baud (load test). The text is therefore
+// written in pieces of at most MPU9250_VIBRATION_TEXT_CHUNK characters (8 ms) with the FIFO drained in between, and
+// printing every 20th sample keeps the serial port at about a quarter of its capacity (26 ms per 100 ms).
+#ifndef MPU9250_OUTPUT_DIVIDER
+#define MPU9250_OUTPUT_DIVIDER (MPU9250_VIBRATION ? 20 : 1)
+#endif
+
+#ifndef MPU9250_VIBRATION_TEXT_CHUNK
+#define MPU9250_VIBRATION_TEXT_CHUNK 96
+#endif
+
+// Print yaw/pitch/roll, heading and gravity-free acceleration (mpu-9250/orientation.hpp) with every fused sample,
+// with the polynomial atan2/asin approximations if MPU9250_FAST_TRIG=1
+#ifndef MPU9250_DERIVED_OUTPUT
+#define MPU9250_DERIVED_OUTPUT 0
+#endif
+
+#ifndef MPU9250_FAST_TRIG
+#define MPU9250_FAST_TRIG 0
+#endif
+
+// Publish every sample to a hub (mpu-9250/sample_hub.hpp) instead of printing it in the acquisition thread. The text
+// output becomes a subscriber in its own thread that drops its oldest samples when the serial port falls behind; other
+// consumers register with mpu9250_subscribe(). Subscriber statistics are printed every MPU9250_HUB_REPORT_SAMPLES samples.
+#ifndef MPU9250_SAMPLE_HUB
+#define MPU9250_SAMPLE_HUB 0
+#endif
+
+#ifndef MPU9250_HUB_REPORT_SAMPLES
+#define MPU9250_HUB_REPORT_SAMPLES 1000
+#endif
+
+#ifndef MPU9250_OUTPUT_QUEUE_DEPTH
+#define MPU9250_OUTPUT_QUEUE_DEPTH 8
+#endif
+
+#ifndef MPU9250_OUTPUT_STACK_SIZE
+#define MPU9250_OUTPUT_STACK_SIZE 2048
+#endif
+
+// Switch the output data rate and the fusion rate with the motion among the tiers of source/motion_sync.cpp
+// (mpu-9250/rate_control.hpp): 50 Hz at rest, 200 Hz in normal motion and 500 Hz in fast manoeuvres. Time per tier and
+// the CPU load against a fixed 200 Hz are printed every MPU9250_RATE_REPORT_MS. Not used by MPU9250_LOG_COMPRESSED.
+#ifndef MPU9250_ADAPTIVE_RATE
+#define MPU9250_ADAPTIVE_RATE 0
+#endif
+
+#ifndef MPU9250_RATE_REPORT_MS
+#define MPU9250_RATE_REPORT_MS 10000
+#endif
+
+// One fused sample as published to the subscribers, all vectors in the body frame
+struct MotionSample {
+    uint32_t timestamp;                 // us_ticker_read() after the accel/gyro read
+    uint16_t health;                    // HealthMonitor flags, 0 without MPU9250_HEALTH_CHECK
+    float accel[3];                     // (m/s2)
+    float gyro[3];                      // (rad/s)
+    float mag[3];                       // (mG)
+    float q[4];                         // NED (w, x, y, z)
+};
+
+// Stack of the acquisition thread started by main()
+#ifndef MPU9250_SYNC_STACK_SIZE
+#define MPU9250_SYNC_STACK_SIZE 4096
+#endif
+
+// Print the RAM budget and the stack high-water marks (mpu-9250/memory_budget.hpp) every MPU9250_MEMORY_REPORT_SAMPLES
+// samples. Combine with MPU9250_STATIC_ALLOCATION=1 to move every object and stack out of the heap.
+#ifndef MPU9250_MEMORY_REPORT
+#define MPU9250_MEMORY_REPORT 0
+#endif
+
+#ifndef MPU9250_MEMORY_REPORT_SAMPLES
+#define MPU9250_MEMORY_REPORT_SAMPLES 2000
+#endif
 
 void mpu9250_sync_task_init(void);
 
+/* Budget the application adds its own objects and threads to, printed with MPU9250_MEMORY_REPORT=1 */
+MemoryBudget* mpu9250_memory_budget(void);
+
+/* Add a consumer of the samples before mpu9250_sync_task_init(); needs MPU9250_SAMPLE_HUB=1 */
+bool mpu9250_subscribe(SampleSubscriber<MotionSample>* subscriber);
+
 void mpu9250_sync_task(void);
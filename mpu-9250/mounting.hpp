@@ -0,0 +1,62 @@
+#pragma once
+
+// Axis-aligned mounting orientations as compile-time signed permutations.
+// This header does not depend on mbed so that it can be built on the host.
+//
+// AxisMount<X, Y, Z> maps sensor axes to the axes of the body frame: body axis i is sensor axis |code_i| - 1, negated
+// if code_i is negative. AxisMount<MOUNT_Y, MOUNT_X, -MOUNT_Z> is body x = sensor y, body y = sensor x,
+// body z = -sensor z. Only rotations are accepted (each sensor axis used once, determinant +1), which covers the 24
+// axis-aligned mounts. axis() and sign() are constant expressions, so the mapping costs nothing per sample once the
+// sign is folded into the scale of each axis.
+enum MountAxis {
+    MOUNT_X = 1,
+    MOUNT_Y = 2,
+    MOUNT_Z = 3
+};
+
+// Determinant of the signed permutation of AxisMount<x, y, z>, +1 for a rotation
+constexpr int mount_determinant(int x, int y, int z) {
+    return (x < 0 ? -1 : 1) * (y < 0 ? -1 : 1) * (z < 0 ? -1 : 1)
+        * ((x < 0 ? -x : x) < (y < 0 ? -y : y) ? 1 : -1)
+        * ((x < 0 ? -x : x) < (z < 0 ? -z : z) ? 1 : -1)
+        * ((y < 0 ? -y : y) < (z < 0 ? -z : z) ? 1 : -1);
+}
+
+template <int X, int Y, int Z>
+struct AxisMount {
+    static_assert(X != 0 && Y != 0 && Z != 0 && X >= -3 && X <= 3 && Y >= -3 && Y <= 3 && Z >= -3 && Z <= 3,
+        "mount axes must be +-MOUNT_X, +-MOUNT_Y or +-MOUNT_Z");
+    static_assert((X < 0 ? -X : X) != (Y < 0 ? -Y : Y) && (X < 0 ? -X : X) != (Z < 0 ? -Z : Z)
+        && (Y < 0 ? -Y : Y) != (Z < 0 ? -Z : Z), "every sensor axis must be used once");
+    static_assert(mount_determinant(X, Y, Z) == 1, "the mount must be a rotation, not a reflection");
+
+    /* Signed code of body axis `i` */
+    static constexpr int code(int i) {
+        return i == 0 ? X : i == 1 ? Y : Z;
+    }
+
+    /* Sensor axis (0..2) of body axis `i` */
+    static constexpr int axis(int i) {
+        return (code(i) < 0 ? -code(i) : code(i)) - 1;
+    }
+
+    /* +1 or -1 */
+    static constexpr int sign(int i) {
+        return code(i) < 0 ? -1 : 1;
+    }
+
+    /* Map `src` in sensor axes to `dest` in body axes; `dest` must not alias `src` */
+    template <typename T>
+    static void apply(const T* src, T* dest) {
+        for (int i = 0; i < 3; i++) {
+            dest[i] = sign(i) < 0 ? -src[axis(i)] : src[axis(i)];
+        }
+    }
+};
+
+// Mount `Outer` applied after `Inner`, e.g. the mount of a chip after the axis mapping between two sensors in it
+template <class Outer, class Inner>
+struct ComposedMount {
+    typedef AxisMount<Outer::sign(0) * Inner::code(Outer::axis(0)), Outer::sign(1) * Inner::code(Outer::axis(1)),
+        Outer::sign(2) * Inner::code(Outer::axis(2))> type;
+};
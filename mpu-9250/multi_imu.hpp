@@ -0,0 +1,248 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/MPU9250.hpp"
+
+#define MULTI_IMU_MAX_DEVICES   4
+#define MULTI_IMU_MAX_BUSES     3
+
+// Per-device acquisition timing, all in microseconds
+struct MultiIMUTiming {
+    uint32_t reads;             // completed reads
+    uint32_t lastOffset;        // start of the last read relative to the period tick
+    uint32_t maxOffset;
+    uint32_t lastDuration;      // duration of the last read
+    uint32_t maxDuration;
+};
+
+// Reads every registered MPU9250 once per sample period.
+//
+// Sensors are grouped by their bus id. The first bus is read by the thread calling acquire(); every other bus has its
+// own worker thread that is released at the same period tick, so transfers on different buses overlap. Within a bus
+// the sensors are read back to back in registration order, so the skew of a period is bounded by the read time of the
+// busiest bus. The skew of every period is compared against the configured bound and violations are counted.
+//
+// Two sensors on one bus must use different AD0 levels and setMagAuxMaster(true), because every AK8963 answers at the
+// same address in bypass mode.
+class MultiIMUScheduler {
+    struct Bus {
+        MultiIMUScheduler* owner;
+        uint8_t id;
+        uint8_t devices[MULTI_IMU_MAX_DEVICES];  // indices into _devices
+        uint8_t count;
+        Thread* thread;
+        Semaphore start;
+        Semaphore done;
+
+        Bus(): owner(NULL), id(0), count(0), thread(NULL), start(0), done(0) {
+        }
+
+        void run(void) {
+            while (true) {
+                start.wait();
+                owner->readBus(this);
+                done.release();
+            }
+        }
+    };
+
+    MPU9250* _devices[MULTI_IMU_MAX_DEVICES];
+    SampleFrame _frames[MULTI_IMU_MAX_DEVICES];
+    uint32_t _timestamps[MULTI_IMU_MAX_DEVICES];   // us_ticker_read() at the start of each read
+    MultiIMUTiming _timing[MULTI_IMU_MAX_DEVICES];
+    uint8_t _count = 0;
+
+    Bus _buses[MULTI_IMU_MAX_BUSES];
+    uint8_t _busCount = 0;
+
+    Ticker _ticker;
+    Semaphore _tick;
+    volatile uint32_t _ticks = 0;
+    uint32_t _handledTicks = 0;
+    uint32_t _periodUs = 0;
+    uint32_t _periodStart = 0;
+
+    uint32_t _skewBoundUs;
+    uint32_t _lastSkew = 0;
+    uint32_t _maxSkew = 0;
+    uint32_t _skewViolations = 0;
+    uint32_t _missedPeriods = 0;
+
+    void onTick(void) {
+        _ticks++;
+        _tick.release();
+    }
+
+    void readBus(Bus* bus) {
+        for (uint8_t i = 0; i < bus->count; i++) {
+            uint8_t d = bus->devices[i];
+            uint32_t start = us_ticker_read();
+            _devices[d]->readRawFrame(&_frames[d]);
+            uint32_t end = us_ticker_read();
+
+            MultiIMUTiming* t = &_timing[d];
+            _timestamps[d] = start;
+            t->reads++;
+            t->lastOffset = start - _periodStart;
+            t->lastDuration = end - start;
+            if (t->lastOffset > t->maxOffset) {
+                t->maxOffset = t->lastOffset;
+            }
+            if (t->lastDuration > t->maxDuration) {
+                t->maxDuration = t->lastDuration;
+            }
+        }
+    }
+
+public:
+    /*
+     * skewBoundUs ... largest accepted difference between the first and the last read start within one period
+     */
+    MultiIMUScheduler(uint32_t skewBoundUs = 1000): _tick(0), _skewBoundUs(skewBoundUs) {
+        memset(_timing, 0, sizeof(_timing));
+        memset(_timestamps, 0, sizeof(_timestamps));
+        memset(_frames, 0, sizeof(_frames));
+    }
+
+    /*
+     * Register a sensor prior to start(). Returns false when the device or bus limit is reached.
+     */
+    bool addDevice(MPU9250* sensor) {
+        if (_count == MULTI_IMU_MAX_DEVICES) {
+            return false;
+        }
+        Bus* bus = NULL;
+        for (uint8_t i = 0; i < _busCount; i++) {
+            if (_buses[i].id == sensor->getBusId()) {
+                bus = &_buses[i];
+            }
+        }
+        if (!bus) {
+            if (_busCount == MULTI_IMU_MAX_BUSES) {
+                return false;
+            }
+            bus = &_buses[_busCount++];
+            bus->owner = this;
+            bus->id = sensor->getBusId();
+        }
+        bus->devices[bus->count++] = _count;
+        _devices[_count++] = sensor;
+        return true;
+    }
+
+    /*
+     * Initialize all registered sensors one after the other. The bypass of every sensor is closed first, so that only
+     * the AK8963 of the sensor being initialized is visible on a shared bus.
+     */
+    void initAll(void) {
+        for (uint8_t i = 0; i < _count; i++) {
+            _devices[i]->writeByte(_devices[i]->getAddress(), INT_PIN_CFG, 0x00);
+        }
+        for (uint8_t i = 0; i < _count; i++) {
+            _devices[i]->initAll();
+        }
+    }
+
+    /*
+     * Start the period ticker and the worker threads of the additional buses
+     */
+    void start(uint32_t periodUs) {
+        _periodUs = periodUs;
+        for (uint8_t i = 1; i < _busCount; i++) {
+            if (!_buses[i].thread) {
+                _buses[i].thread = new Thread(osPriorityAboveNormal);
+                _buses[i].thread->start(callback(&_buses[i], &Bus::run));
+            }
+        }
+        _ticker.attach_us(callback(this, &MultiIMUScheduler::onTick), periodUs);
+    }
+
+    void stop(void) {
+        _ticker.detach();
+    }
+
+    /*
+     * Wait for the next period tick and read all sensors. Frames and timestamps stay valid until the next call.
+     * Returns the skew of this period in microseconds.
+     */
+    uint32_t acquire(void) {
+        _tick.wait();
+        while (_tick.wait(0) > 0); // Drop ticks queued while the caller was late, they are counted below
+        _periodStart = us_ticker_read();
+        uint32_t ticks = _ticks;
+        if (ticks - _handledTicks > 1) {
+            _missedPeriods += ticks - _handledTicks - 1;
+        }
+        _handledTicks = ticks;
+
+        for (uint8_t i = 1; i < _busCount; i++) {
+            _buses[i].start.release();
+        }
+        if (_busCount > 0) {
+            readBus(&_buses[0]);
+        }
+        for (uint8_t i = 1; i < _busCount; i++) {
+            _buses[i].done.wait();
+        }
+
+        uint32_t first = 0xFFFFFFFF, last = 0;
+        for (uint8_t i = 0; i < _count; i++) {
+            uint32_t offset = _timing[i].lastOffset;
+            first = offset < first ? offset : first;
+            last = offset > last ? offset : last;
+        }
+        _lastSkew = _count ? last - first : 0;
+        if (_lastSkew > _maxSkew) {
+            _maxSkew = _lastSkew;
+        }
+        if (_lastSkew > _skewBoundUs) {
+            _skewViolations++;
+        }
+        return _lastSkew;
+    }
+
+    uint8_t getDeviceCount(void) {
+        return _count;
+    }
+
+    MPU9250* getDevice(uint8_t index) {
+        return _devices[index];
+    }
+
+    const SampleFrame& getFrame(uint8_t index) {
+        return _frames[index];
+    }
+
+    uint32_t getTimestamp(uint8_t index) {
+        return _timestamps[index];
+    }
+
+    const MultiIMUTiming& getTiming(uint8_t index) {
+        return _timing[index];
+    }
+
+    uint32_t getMaxSkew(void) {
+        return _maxSkew;
+    }
+
+    uint32_t getSkewViolations(void) {
+        return _skewViolations;
+    }
+
+    uint32_t getMissedPeriods(void) {
+        return _missedPeriods;
+    }
+
+    void printTiming(void) {
+        printf("[MULTI-IMU] period: %lu us skew: %lu us (max %lu us, bound %lu us, violations %lu) missed periods: %lu\r\n",
+            (unsigned long) _periodUs, (unsigned long) _lastSkew, (unsigned long) _maxSkew,
+            (unsigned long) _skewBoundUs, (unsigned long) _skewViolations, (unsigned long) _missedPeriods);
+        for (uint8_t i = 0; i < _count; i++) {
+            const MultiIMUTiming& t = _timing[i];
+            printf("[MULTI-IMU] #%u bus %u addr 0x%02X reads: %lu offset: %lu us (max %lu us) read: %lu us (max %lu us)\r\n",
+                i, _devices[i]->getBusId(), _devices[i]->getAddress() >> 1, (unsigned long) t.reads,
+                (unsigned long) t.lastOffset, (unsigned long) t.maxOffset,
+                (unsigned long) t.lastDuration, (unsigned long) t.maxDuration);
+        }
+    }
+};
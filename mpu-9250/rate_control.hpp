@@ -0,0 +1,232 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/MPU9250.hpp"
+
+// Motion-adaptive output data rate and fusion rate.
+//
+// The controller switches the sensor among configured tiers, from a slow tier for a device at rest to a fast one for
+// quick manoeuvres. Each tier sets SMPLRT_DIV, the low-pass filter and the AK8963 mode (MPU9250::setSampleRate()), and
+// the acquisition loop reads and fuses a sample only when isDue() says one period of the tier has passed. The activity
+// comes from the output of MPU9250::transformAccelGyro(): the gyro magnitude of every sample and the variance of the
+// accel magnitude, an exponential average with time constant `varianceTauMs` whatever the rate.
+//
+// Switching up happens on the first sample above the thresholds of a faster tier. Switching down happens only after
+// the activity stayed below `hysteresis` times the thresholds of the current tier for `holdMs`. The fusion takes its
+// step from the measured time between updates, so it follows each switch without a correction.
+#ifndef RATE_CONTROL_MAX_TIERS
+#define RATE_CONTROL_MAX_TIERS 4
+#endif
+
+struct RateTier {
+    const char* name;
+    uint8_t smplrtDiv;                  // output data rate 1 kHz / (1 + smplrtDiv)
+    uint8_t dlpf;                       // DLPF_CFG and A_DLPFCFG, 1 (184 Hz) to 6 (5 Hz) bandwidth
+    uint8_t magMode;                    // AK8963 continuous mode, 0x02 (8 Hz) or 0x06 (100 Hz)
+    float gyro;                         // rad/s, the tier is entered above this rotation rate
+    float accelVariance;                // (m/s2)^2, or above this variance of the accel magnitude; both unused for tier 0
+};
+
+struct RateTierStats {
+    uint32_t timeMs;
+    uint32_t samples;                   // samples processed in the tier
+    uint64_t workUs;                    // time reported with addWork()
+    uint32_t entries;
+};
+
+class RateController {
+    MPU9250* _sensor;
+    const RateTier* _tiers;
+    uint8_t _count;
+    uint8_t _tier;
+    uint8_t _reference;                 // fixed tier the CPU time is compared against
+    bool _pending = true;               // _tier is not applied to the sensor yet
+    float _hysteresis;
+    uint32_t _holdMs;
+    float _tauUs;
+    uint32_t _periodUs;
+    uint32_t _next = 0;                 // due time of the next sample
+    float _mean = 0.0f;                 // accel magnitude (m/s2)
+    float _variance = 0.0f;
+    bool _primed = false;
+    Timer _timer;
+    uint32_t _tierStartMs = 0;
+    uint32_t _belowMs = 0;              // start of the current period of low activity
+    bool _below = false;
+    RateTierStats _stats[RATE_CONTROL_MAX_TIERS];
+
+    // Fastest tier whose thresholds the activity exceeds; tiers up to the current one need only `_hysteresis` of them
+    uint8_t level(float gyro, float variance) {
+        for (uint8_t i = _count - 1; i > 0; i--) {
+            float scale = i <= _tier ? _hysteresis : 1.0f;
+            if (gyro > _tiers[i].gyro * scale || variance > _tiers[i].accelVariance * scale) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    void account(uint32_t now) {
+        _stats[_tier].timeMs += now - _tierStartMs;
+        _tierStartMs = now;
+    }
+
+    void apply(uint8_t tier) {
+        uint32_t now = _timer.read_ms();
+        account(now);
+        _tier = tier;
+        _stats[tier].entries++;
+        _below = false;
+        const RateTier& t = _tiers[tier];
+        _sensor->setSampleRate(t.smplrtDiv, t.dlpf, t.magMode);
+        _periodUs = 1000 * (1 + t.smplrtDiv);
+        _next = us_ticker_read() + _periodUs;
+        _pending = false;
+    }
+
+public:
+    /*
+     * tiers ... from the slowest to the fastest, with increasing thresholds; at most RATE_CONTROL_MAX_TIERS
+     * initial ... tier until the first update(), also the reference of the CPU saving (e.g. the 200 Hz of initAll())
+     * hysteresis ... fraction of the thresholds of the current tier the activity must stay below to switch down
+     * holdMs ... time below before switching down
+     * varianceTauMs ... time constant of the accel variance
+     */
+    RateController(MPU9250* sensor, const RateTier* tiers, uint8_t count, uint8_t initial, float hysteresis = 0.7f,
+                   uint32_t holdMs = 1000, uint32_t varianceTauMs = 250):
+        _sensor(sensor), _tiers(tiers), _count(count > RATE_CONTROL_MAX_TIERS ? RATE_CONTROL_MAX_TIERS : count),
+        _tier(initial), _reference(initial), _hysteresis(hysteresis), _holdMs(holdMs), _tauUs(varianceTauMs * 1000.0f),
+        _periodUs(1000 * (1 + tiers[initial].smplrtDiv)) {
+        memset(_stats, 0, sizeof(_stats));
+        _timer.start();
+    }
+
+    /* True when the next sample of the current tier is due; the caller then reads and fuses it */
+    bool isDue(void) {
+        uint32_t now = us_ticker_read();
+        if ((int32_t) (now - _next) < 0) {
+            return false;
+        }
+        _next += _periodUs;
+        if ((int32_t) (now - _next) >= 0) {
+            _next = now + _periodUs;    // more than a period late, restart the schedule
+        }
+        return true;
+    }
+
+    /*
+     * Feed the output of MPU9250::transformAccelGyro() (float or Q15.16, read with MPU9250::outputToFloat()).
+     * Returns true if the tier changed.
+     */
+    bool update(const uint8_t* accelGyro) {
+        float a2 = 0.0f, g2 = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            float a = MPU9250::outputToFloat(accelGyro, i);
+            float g = MPU9250::outputToFloat(accelGyro, 3 + i);
+            a2 += a * a;
+            g2 += g * g;
+        }
+        float magnitude = sqrtf(a2);
+        if (!_primed) {
+            _mean = magnitude;
+            _primed = true;
+        }
+        float alpha = _periodUs / _tauUs;
+        alpha = alpha > 1.0f ? 1.0f : alpha;
+        float d = magnitude - _mean;
+        _mean += alpha * d;
+        _variance += alpha * (d * d - _variance);
+        _stats[_tier].samples++;
+
+        if (_pending) {
+            apply(_tier);
+            return true;
+        }
+        uint8_t target = level(sqrtf(g2), _variance);
+        if (target > _tier) {
+            apply(target);
+            return true;
+        }
+        if (target == _tier) {
+            _below = false;
+            return false;
+        }
+        uint32_t now = _timer.read_ms();
+        if (!_below) {
+            _below = true;
+            _belowMs = now;
+        } else if (now - _belowMs >= _holdMs) {
+            apply(target);
+            return true;
+        }
+        return false;
+    }
+
+    /* Time (us) spent on the sample just processed, for the CPU report */
+    void addWork(uint32_t us) {
+        _stats[_tier].workUs += us;
+    }
+
+    uint8_t getTier(void) {
+        return _tier;
+    }
+
+    const RateTier& getTierConfig(void) {
+        return _tiers[_tier];
+    }
+
+    /* Sample period (us) of the current tier */
+    uint32_t getPeriodUs(void) {
+        return _periodUs;
+    }
+
+    float getAccelVariance(void) {
+        return _variance;
+    }
+
+    uint32_t getElapsedMs(void) {
+        return _timer.read_ms();
+    }
+
+    /* Statistics of `tier` up to now */
+    void getStats(uint8_t tier, RateTierStats* stats) {
+        account(_timer.read_ms());
+        *stats = _stats[tier];
+    }
+
+    void reset(void) {
+        memset(_stats, 0, sizeof(_stats));
+        _timer.reset();
+        _tierStartMs = 0;
+        _belowMs = 0;
+    }
+
+    /*
+     * Time, samples and work per tier and the CPU load against running the reference tier all the time. The reference
+     * load takes the average work per sample over all tiers, i.e. it assumes the cost of a sample does not depend on
+     * the rate.
+     */
+    void print(void) {
+        account(_timer.read_ms());
+        uint32_t totalMs = 0, samples = 0;
+        uint64_t workUs = 0;
+        for (uint8_t i = 0; i < _count; i++) {
+            totalMs += _stats[i].timeMs;
+            samples += _stats[i].samples;
+            workUs += _stats[i].workUs;
+        }
+        uint32_t total = totalMs ? totalMs : 1;
+        for (uint8_t i = 0; i < _count; i++) {
+            const RateTierStats& s = _stats[i];
+            printf("[RATE] %c %-8s %4u Hz time: %7lu ms (%3lu %%) entries: %5lu samples: %7lu work: %5lu us/sample\r\n",
+                i == _tier ? '*' : ' ', _tiers[i].name, 1000 / (1 + _tiers[i].smplrtDiv), (unsigned long) s.timeMs,
+                (unsigned long) (100ull * s.timeMs / total), (unsigned long) s.entries, (unsigned long) s.samples,
+                (unsigned long) (s.samples ? s.workUs / s.samples : 0));
+        }
+        uint32_t referenceHz = 1000 / (1 + _tiers[_reference].smplrtDiv);
+        float load = workUs / (10.0f * total);
+        float referenceLoad = samples ? load * ((float) referenceHz * total / 1000.0f) / samples : 0.0f;
+        printf("[RATE] load: %.1f %% fixed %lu Hz: %.1f %% saved: %.1f %%\r\n", load, (unsigned long) referenceHz,
+            referenceLoad, referenceLoad - load);
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "mpu-9250/MPU9250-common.hpp"
+
+// Desired state of (some bits of) one register, see MPU9250::applyConfig()
+struct RegisterSetting {
+    uint8_t reg;
+    uint8_t mask;                       // bits set by `value`, the other bits are kept
+    uint8_t value;
+};
+
+// Host-side copy of the MPU9250 configuration registers.
+//
+// Only plain read/write configuration registers are cached; registers with self-clearing or side-effect bits
+// (USER_CTRL, PWR_MGMT_1, SIGNAL_PATH_RESET, FIFO_R_W, status registers) always go to the device.
+// A register is valid once it has been written or read back, and everything is invalidated by a device reset.
+class RegisterShadow {
+    uint8_t _values[128];
+    uint32_t _valid[4];
+
+public:
+    RegisterShadow() {
+        memset(_values, 0, sizeof(_values));
+        invalidate();
+    }
+
+    static bool isCached(uint8_t reg) {
+        return (reg >= SMPLRT_DIV && reg <= WOM_THR) ||
+            (reg >= FIFO_EN && reg <= I2C_SLV0_CTRL) ||
+            reg == INT_PIN_CFG || reg == INT_ENABLE ||
+            reg == MOT_DETECT_CTRL || reg == PWR_MGMT_2;
+    }
+
+    void invalidate(void) {
+        memset(_valid, 0, sizeof(_valid));
+    }
+
+    bool isValid(uint8_t reg) const {
+        return reg < 128 && (_valid[reg >> 5] & (1uL << (reg & 31)));
+    }
+
+    uint8_t get(uint8_t reg) const {
+        return _values[reg & 0x7F];
+    }
+
+    /* Record a value written to or read from the device; ignored for registers that are not cached */
+    void store(uint8_t reg, uint8_t value) {
+        if (isCached(reg)) {
+            _values[reg] = value;
+            _valid[reg >> 5] |= 1uL << (reg & 31);
+        }
+    }
+};
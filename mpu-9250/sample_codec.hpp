@@ -0,0 +1,229 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mpu-9250/sample_frame.hpp"
+
+// Streaming codec for raw SampleFrame values.
+//
+// Each channel is coded as the 16-bit wrapping delta against the previous frame, mapped to an unsigned value with
+// zigzag encoding and written as a little-endian base-128 varint (1 to 3 bytes). The predictor restarts at every
+// block, so a block decodes on its own and a corrupted block only loses its own frames.
+//
+// Block layout:
+//   [0]    0xA5 sync
+//   [1]    0x5A sync
+//   [2]    number of frames in the block
+//   [3:4]  payload length (little endian)
+//   [5:8]  sequence number of the first frame, counting every frame of the stream (little endian)
+//   [9:12] timestamp of the first frame in us (little endian), e.g. us_ticker_read()
+//   [13:]  payload
+//   [-2:]  Fletcher-16 checksum over bytes [2] to the end of the payload (little endian)
+//
+// The frames of a block are consecutive samples. A jump of the sequence number between blocks means lost blocks; a
+// timestamp step longer than the frames of the previous block at the sample rate means samples that were never
+// logged.
+//
+// Both classes only use the memory they are declared with and do not depend on mbed, so the decoder builds on the host.
+
+#define SAMPLE_CODEC_SYNC0          0xA5
+#define SAMPLE_CODEC_SYNC1          0x5A
+#define SAMPLE_CODEC_HEADER_SIZE    13
+#define SAMPLE_CODEC_TRAILER_SIZE   2
+#define SAMPLE_CODEC_MAX_FRAME_SIZE (SAMPLE_FRAME_CHANNELS * 3)   // 16-bit zigzag value needs at most 3 varint bytes
+#define SAMPLE_CODEC_MAX_FRAMES     255
+
+inline uint16_t sample_codec_checksum(const uint8_t* data, size_t length) {
+    uint16_t sum1 = 0, sum2 = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)(sum2 << 8 | sum1);
+}
+
+template <size_t BLOCK_SIZE = 512>
+class SampleEncoder {
+    static_assert(BLOCK_SIZE >= SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_FRAME_SIZE + SAMPLE_CODEC_TRAILER_SIZE,
+                  "block cannot hold a single frame");
+    static_assert(BLOCK_SIZE <= SAMPLE_CODEC_HEADER_SIZE + 0xFFFF + SAMPLE_CODEC_TRAILER_SIZE,
+                  "payload length must fit in 16 bits");
+
+    uint8_t _block[BLOCK_SIZE];
+    size_t _length;
+    uint8_t _frames;
+    uint32_t _sequence = 0;             // of the next frame
+    uint32_t _timestamp = 0;            // of the first frame of the block
+    int16_t _prev[SAMPLE_FRAME_CHANNELS];
+
+    static void put32(uint8_t* p, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            p[i] = (uint8_t) (value >> (8 * i));
+        }
+    }
+
+public:
+    SampleEncoder() {
+        reset();
+    }
+
+    /*
+     * Start a new block. Call after the block returned by finish() has been written out.
+     */
+    void reset(void) {
+        _length = SAMPLE_CODEC_HEADER_SIZE;
+        _frames = 0;
+        for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+            _prev[i] = 0;
+        }
+    }
+
+    uint8_t frameCount(void) const {
+        return _frames;
+    }
+
+    /*
+     * Append a frame read at `timestamp` (us) to the current block.
+     * Returns false without consuming the frame when the block has no room left for a worst-case frame;
+     * the caller must then finish() the block, write it, reset() and append the frame again.
+     */
+    bool append(const SampleFrame& frame, uint32_t timestamp = 0) {
+        if (_frames == SAMPLE_CODEC_MAX_FRAMES ||
+            _length + SAMPLE_CODEC_MAX_FRAME_SIZE + SAMPLE_CODEC_TRAILER_SIZE > BLOCK_SIZE) {
+            return false;
+        }
+        if (_frames == 0) {
+            _timestamp = timestamp;
+        }
+        uint8_t* p = &_block[_length];
+        for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+            int16_t delta = (int16_t)(frame.values[i] - _prev[i]);
+            _prev[i] = frame.values[i];
+            uint16_t z = (uint16_t)((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15); // zigzag
+            while (z >= 0x80) {
+                *p++ = (uint8_t)(z | 0x80);
+                z >>= 7;
+            }
+            *p++ = (uint8_t) z;
+        }
+        _length = p - _block;
+        _frames++;
+        _sequence++;
+        return true;
+    }
+
+    /*
+     * Write the block header and checksum, and return the complete block.
+     * The block stays valid until reset() is called.
+     */
+    const uint8_t* finish(size_t* length) {
+        size_t payload = _length - SAMPLE_CODEC_HEADER_SIZE;
+        _block[0] = SAMPLE_CODEC_SYNC0;
+        _block[1] = SAMPLE_CODEC_SYNC1;
+        _block[2] = _frames;
+        _block[3] = payload & 0xFF;
+        _block[4] = (payload >> 8) & 0xFF;
+        put32(&_block[5], _sequence - _frames);
+        put32(&_block[9], _timestamp);
+        uint16_t sum = sample_codec_checksum(&_block[2], _length - 2);
+        _block[_length] = sum & 0xFF;
+        _block[_length + 1] = (sum >> 8) & 0xFF;
+        *length = _length + SAMPLE_CODEC_TRAILER_SIZE;
+        return _block;
+    }
+};
+
+class SampleDecoder {
+    const uint8_t* _p;
+    const uint8_t* _end;
+    uint8_t _remaining;
+    uint32_t _sequence;
+    uint32_t _timestamp;
+    int16_t _prev[SAMPLE_FRAME_CHANNELS];
+
+    static uint32_t get32(const uint8_t* p) {
+        return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    }
+
+public:
+    SampleDecoder(): _p(0), _end(0), _remaining(0), _sequence(0), _timestamp(0) {
+    }
+
+    /*
+     * Total block size announced by a header, or 0 if `header` (at least SAMPLE_CODEC_HEADER_SIZE bytes)
+     * does not start with the sync bytes or its payload length cannot hold its number of frames.
+     */
+    static size_t blockLength(const uint8_t* header) {
+        if (header[0] != SAMPLE_CODEC_SYNC0 || header[1] != SAMPLE_CODEC_SYNC1) {
+            return 0;
+        }
+        size_t frames = header[2];
+        size_t payload = header[3] | (size_t) header[4] << 8;
+        if (payload < frames * SAMPLE_FRAME_CHANNELS || payload > frames * SAMPLE_CODEC_MAX_FRAME_SIZE) {
+            return 0;
+        }
+        return SAMPLE_CODEC_HEADER_SIZE + payload + SAMPLE_CODEC_TRAILER_SIZE;
+    }
+
+    /*
+     * Validate a complete block and prepare to decode its frames.
+     */
+    bool begin(const uint8_t* block, size_t length) {
+        _remaining = 0;
+        if (length < SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_TRAILER_SIZE || blockLength(block) != length) {
+            return false;
+        }
+        size_t body = length - SAMPLE_CODEC_TRAILER_SIZE;
+        uint16_t sum = block[body] | (uint16_t) block[body + 1] << 8;
+        if (sample_codec_checksum(&block[2], body - 2) != sum) {
+            return false;
+        }
+        _p = &block[SAMPLE_CODEC_HEADER_SIZE];
+        _end = &block[body];
+        _remaining = block[2];
+        _sequence = get32(&block[5]);
+        _timestamp = get32(&block[9]);
+        for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+            _prev[i] = 0;
+        }
+        return true;
+    }
+
+    /* Sequence number of the first frame of the block given to begin() */
+    uint32_t getSequence(void) const {
+        return _sequence;
+    }
+
+    /* Timestamp (us) of the first frame of the block given to begin() */
+    uint32_t getTimestamp(void) const {
+        return _timestamp;
+    }
+
+    /*
+     * Decode the next frame of the block; returns false at the end of the block or on a malformed payload.
+     */
+    bool next(SampleFrame* frame) {
+        if (_remaining == 0) {
+            return false;
+        }
+        for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+            uint32_t z = 0;
+            int shift = 0;
+            uint8_t b;
+            do {
+                if (_p == _end || shift > 14) {
+                    _remaining = 0;
+                    return false;
+                }
+                b = *_p++;
+                z |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            int16_t delta = (int16_t)((z >> 1) ^ (0u - (z & 1)));
+            _prev[i] = (int16_t)(_prev[i] + delta);
+            frame->values[i] = _prev[i];
+        }
+        _remaining--;
+        return true;
+    }
+};
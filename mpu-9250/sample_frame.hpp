@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Raw sensor frame in register order: accel x/y/z, temperature, gyro x/y/z (MPU9250 burst from ACCEL_XOUT_H)
+// followed by mag x/y/z (AK8963). All values are signed 16-bit LSB as read from the devices.
+// This header does not depend on mbed so that host tools can share it.
+enum SampleFrameChannel {
+    FRAME_ACCEL_X = 0,
+    FRAME_ACCEL_Y,
+    FRAME_ACCEL_Z,
+    FRAME_TEMP,
+    FRAME_GYRO_X,
+    FRAME_GYRO_Y,
+    FRAME_GYRO_Z,
+    FRAME_MAG_X,
+    FRAME_MAG_Y,
+    FRAME_MAG_Z,
+    SAMPLE_FRAME_CHANNELS
+};
+
+struct SampleFrame {
+    int16_t values[SAMPLE_FRAME_CHANNELS];
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "mbed.h"
+
+// Fan-out of samples from the acquisition thread to several consumers without heap allocation.
+//
+// Every subscriber owns a bounded queue (SampleQueue<T, DEPTH>), usually in static storage, and consumes it in its own
+// thread with receive(). publish() never blocks: it copies the sample into each queue inside a short critical section
+// and wakes the consumer. When a queue is full its policy decides which sample is lost, so a slow consumer only loses
+// its own samples and never delays acquisition or the other subscribers. A subscriber may also take every N-th sample
+// only (decimation), e.g. for telemetry at a fraction of the sample rate.
+#ifndef SAMPLE_HUB_MAX_SUBSCRIBERS
+#define SAMPLE_HUB_MAX_SUBSCRIBERS 4
+#endif
+
+enum SubscriberPolicy {
+    SUBSCRIBER_DROP_OLDEST = 0,         // a full queue drops its oldest sample, the consumer sees the latest data
+    SUBSCRIBER_DROP_NEWEST              // a full queue drops the new sample, the consumer sees a gapless prefix
+};
+
+struct SubscriberStats {
+    uint32_t offered;                   // samples left after decimation
+    uint32_t received;
+    uint32_t dropped;                   // lost because the queue was full
+    uint32_t lag;                       // samples published since the last received one
+    uint16_t depth;                     // queued samples
+    uint16_t maxDepth;
+    uint16_t capacity;
+};
+
+template <typename T, int MAX_SUBSCRIBERS>
+class SampleHub;
+
+// Queue of one consumer; see SampleQueue for the storage
+template <typename T>
+class SampleSubscriber {
+    template <typename, int> friend class SampleHub;
+
+protected:
+    struct Entry {
+        uint32_t sequence;
+        T sample;
+    };
+
+private:
+    Entry* _entries;
+    const char* _name;
+    uint16_t _capacity;
+    uint16_t _decimation;
+    SubscriberPolicy _policy;
+    uint16_t _head = 0;                 // oldest queued entry
+    uint16_t _count = 0;
+    uint16_t _maxCount = 0;
+    uint16_t _skipped = 0;              // samples since the last one taken by the decimation
+    uint32_t _offered = 0;
+    uint32_t _received = 0;
+    uint32_t _dropped = 0;
+    uint32_t _published = 0;            // sequence of the last published sample
+    uint32_t _consumed = 0;             // sequence of the last received sample
+    Semaphore _available;               // released when a sample goes into an empty queue
+
+    // Publisher side, called by SampleHub::publish()
+    void offer(const T& sample, uint32_t sequence) {
+        _published = sequence;
+        if (++_skipped < _decimation) {
+            return;
+        }
+        _skipped = 0;
+        bool wake;
+        core_util_critical_section_enter();
+        _offered++;
+        if (_count == _capacity) {
+            _dropped++;
+            if (_policy == SUBSCRIBER_DROP_NEWEST) {
+                core_util_critical_section_exit();
+                return;
+            }
+            _head = _head + 1 == _capacity ? 0 : _head + 1;
+            _count--;
+        }
+        uint16_t tail = _head + _count;
+        Entry& entry = _entries[tail >= _capacity ? tail - _capacity : tail];
+        entry.sequence = sequence;
+        entry.sample = sample;
+        wake = _count++ == 0;
+        if (_count > _maxCount) {
+            _maxCount = _count;
+        }
+        core_util_critical_section_exit();
+        if (wake) {
+            _available.release();
+        }
+    }
+
+protected:
+    SampleSubscriber(Entry* entries, uint16_t capacity, const char* name, SubscriberPolicy policy, uint16_t decimation):
+        _entries(entries), _name(name), _capacity(capacity), _decimation(decimation ? decimation : 1), _policy(policy),
+        _available(0) {
+    }
+
+public:
+    const char* getName(void) const {
+        return _name;
+    }
+
+    /* Take the oldest queued sample without waiting; `sequence` receives its publish number if not NULL */
+    bool poll(T* out, uint32_t* sequence = NULL) {
+        core_util_critical_section_enter();
+        if (_count == 0) {
+            core_util_critical_section_exit();
+            return false;
+        }
+        const Entry& entry = _entries[_head];
+        *out = entry.sample;
+        _consumed = entry.sequence;
+        _head = _head + 1 == _capacity ? 0 : _head + 1;
+        _count--;
+        _received++;
+        core_util_critical_section_exit();
+        if (sequence) {
+            *sequence = _consumed;
+        }
+        return true;
+    }
+
+    /* Wait up to `timeoutMs` for a sample; returns false on timeout */
+    bool receive(T* out, uint32_t timeoutMs = osWaitForever, uint32_t* sequence = NULL) {
+        // A token may be left from a sample that poll() already took, so an empty queue after a wakeup waits again
+        while (!poll(out, sequence)) {
+            if (_available.wait(timeoutMs) <= 0) {
+                return poll(out, sequence);
+            }
+        }
+        return true;
+    }
+
+    void getStats(SubscriberStats* stats) {
+        core_util_critical_section_enter();
+        stats->offered = _offered;
+        stats->received = _received;
+        stats->dropped = _dropped;
+        stats->lag = _published - _consumed;
+        stats->depth = _count;
+        stats->maxDepth = _maxCount;
+        stats->capacity = _capacity;
+        core_util_critical_section_exit();
+    }
+};
+
+// Subscriber with storage for DEPTH samples
+template <typename T, int DEPTH>
+class SampleQueue: public SampleSubscriber<T> {
+    static_assert(DEPTH > 0 && DEPTH <= 0xFFFF, "DEPTH must fit the 16-bit queue indexes");
+
+    typename SampleSubscriber<T>::Entry _storage[DEPTH];
+
+public:
+    /*
+     * name ... shown by SampleHub::print()
+     * policy ... which sample a full queue drops
+     * decimation ... take every `decimation`-th published sample only
+     */
+    SampleQueue(const char* name, SubscriberPolicy policy = SUBSCRIBER_DROP_OLDEST, uint16_t decimation = 1):
+        SampleSubscriber<T>(_storage, DEPTH, name, policy, decimation) {
+    }
+};
+
+template <typename T, int MAX_SUBSCRIBERS = SAMPLE_HUB_MAX_SUBSCRIBERS>
+class SampleHub {
+    SampleSubscriber<T>* _subscribers[MAX_SUBSCRIBERS];
+    uint8_t _count = 0;
+    uint32_t _sequence = 0;
+
+public:
+    /* Add a subscriber before the first publish(); returns false when all MAX_SUBSCRIBERS slots are taken */
+    bool subscribe(SampleSubscriber<T>* subscriber) {
+        if (_count >= MAX_SUBSCRIBERS) {
+            return false;
+        }
+        subscriber->_published = subscriber->_consumed = _sequence;
+        _subscribers[_count++] = subscriber;
+        return true;
+    }
+
+    /* Acquisition thread: hand `sample` to every subscriber; returns its sequence number, counting from 1 */
+    uint32_t publish(const T& sample) {
+        _sequence++;
+        for (uint8_t i = 0; i < _count; i++) {
+            _subscribers[i]->offer(sample, _sequence);
+        }
+        return _sequence;
+    }
+
+    uint32_t getSequence(void) const {
+        return _sequence;
+    }
+
+    void print(void) {
+        SubscriberStats stats;
+        printf("[HUB] published: %lu\r\n", (unsigned long) _sequence);
+        for (uint8_t i = 0; i < _count; i++) {
+            _subscribers[i]->getStats(&stats);
+            printf("[HUB] %-10s offered: %lu received: %lu dropped: %lu lag: %lu queue: %u/%u (max %u)\r\n",
+                _subscribers[i]->getName(), (unsigned long) stats.offered, (unsigned long) stats.received,
+                (unsigned long) stats.dropped, (unsigned long) stats.lag, stats.depth, stats.capacity, stats.maxDepth);
+        }
+    }
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fixed-width decimal formatting into a preallocated line buffer, written out with a single fwrite().
+//
+// appendFloat(v, 11, 6) produces the same text as printf("%11.6f", v): the fraction is taken as an exact 64-bit binary
+// fraction and rounded half to even in integer arithmetic, without double precision. Only magnitudes below 2^-41 lose
+// fraction bits, which is far below any printed digit. appendQ16() formats Q15.16 values exactly.
+// Magnitudes of 2^32 and above print as "ovf". When the buffer is full, further text is dropped.
+#define TEXT_FORMAT_MAX_DECIMALS 9
+
+template <size_t SIZE = 256>
+class TextBuffer {
+    char _buffer[SIZE];
+    size_t _length = 0;
+
+    static uint32_t pow10(uint8_t decimals) {
+        static const uint32_t table[TEXT_FORMAT_MAX_DECIMALS + 1] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+        };
+        return table[decimals];
+    }
+
+    // Right-align `text` of `length` characters in a field of `width`
+    void appendField(const char* text, size_t length, uint8_t width) {
+        for (size_t i = length; i < width && _length < SIZE; i++) {
+            _buffer[_length++] = ' ';
+        }
+        if (length > SIZE - _length) {
+            length = SIZE - _length;
+        }
+        memcpy(&_buffer[_length], text, length);
+        _length += length;
+    }
+
+    // `integer` plus the binary fraction `fraction64` / 2^64, rounded to `decimals` digits half to even like printf
+    void appendDecimal(bool negative, uint32_t integer, uint64_t fraction64, uint8_t decimals, uint8_t width) {
+        uint32_t scale = pow10(decimals);
+        // fraction64 * scale as 96 bits: the decimal digits in the upper 32 bits, the rest below
+        uint64_t low = (uint64_t) (uint32_t) fraction64 * scale;
+        uint64_t high = (fraction64 >> 32) * scale + (low >> 32);
+        uint32_t fraction = (uint32_t) (high >> 32);
+        uint64_t rest = high << 32 | (uint32_t) low;
+        const uint64_t half = 1ull << 63;
+        if (rest > half || (rest == half && ((decimals ? fraction : integer) & 1))) {
+            if (++fraction >= scale) {
+                integer++;
+                fraction = 0;
+            }
+        }
+
+        char digits[24];                // sign, 10 integer digits, point, TEXT_FORMAT_MAX_DECIMALS
+        char* p = &digits[sizeof(digits)];
+        for (uint8_t i = 0; i < decimals; i++) {
+            *--p = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        if (decimals) {
+            *--p = '.';
+        }
+        do {
+            *--p = '0' + integer % 10;
+            integer /= 10;
+        } while (integer);
+        if (negative) {
+            *--p = '-';
+        }
+        appendField(p, &digits[sizeof(digits)] - p, width);
+    }
+
+public:
+    void reset(void) {
+        _length = 0;
+    }
+
+    const char* data(void) const {
+        return _buffer;
+    }
+
+    size_t length(void) const {
+        return _length;
+    }
+
+    void append(const char* text) {
+        appendField(text, strlen(text), 0);
+    }
+
+    /* Same as printf("%0*X", digits, value) */
+    void appendHex(uint32_t value, uint8_t digits) {
+        char hex[8];
+        if (digits > 8) {
+            digits = 8;
+        }
+        for (int i = digits - 1; i >= 0; i--) {
+            hex[i] = "0123456789ABCDEF"[value & 0xF];
+            value >>= 4;
+        }
+        appendField(hex, digits, 0);
+    }
+
+    /* Same as printf("%*.*f", width, decimals, value) */
+    void appendFloat(float value, uint8_t width = 0, uint8_t decimals = 6) {
+        if (isnan(value)) {
+            appendField("nan", 3, width);
+            return;
+        }
+        bool negative = signbit(value);
+        float v = fabsf(value);
+        if (v >= 4294967296.0f) {
+            appendField(negative ? "-ovf" : "ovf", negative ? 4 : 3, width);
+            return;
+        }
+        uint32_t integer = (uint32_t) v;
+        // v - integer is exact; scaling by 2^64 is exact as well
+        appendDecimal(negative, integer, (uint64_t) ((v - (float) integer) * 18446744073709551616.0f), decimals, width);
+    }
+
+    /* Q15.16 (or any Qx.16) value, rounded exactly */
+    void appendQ16(int32_t value, uint8_t width = 0, uint8_t decimals = 6) {
+        bool negative = value < 0;
+        uint32_t v = negative ? 0u - (uint32_t) value : (uint32_t) value;
+        appendDecimal(negative, v >> 16, (uint64_t) (v & 0xFFFF) << 48, decimals, width);
+    }
+
+    /* Write the buffer with one call and start a new one; returns the number of bytes written */
+    size_t flush(FILE* stream = stdout) {
+        size_t written = fwrite(_buffer, 1, _length, stream);
+        fflush(stream);
+        _length = 0;
+        return written;
+    }
+};
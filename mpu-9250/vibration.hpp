@@ -0,0 +1,124 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/fft.hpp"
+
+#ifndef VIBRATION_STACK_SIZE
+#define VIBRATION_STACK_SIZE 2048       // the FFT works on member buffers; the stack is for the printf of the report
+#endif
+
+// Vibration spectrum of one accelerometer axis, computed in its own low-priority thread.
+//
+// The acquisition thread push()es samples into one of two blocks of N samples. Once a block is full, the analysis
+// thread is released and computes the spectrum while the other block fills, so the acquisition thread only copies a
+// value per sample. If the analysis has not finished when the next block is full, the new block is dropped and counted.
+// The analysis thread also prints the report, which takes about 40 ms at 115200 baud and would otherwise stall the
+// acquisition.
+// All memory (two sample blocks, the FFT tables, window and work buffer, about 17 * N bytes plus the stack) is part of
+// the object.
+template <int N = 256>
+class VibrationMonitor {
+    VibrationAnalysis<N> _analysis;
+    int16_t _blocks[2][N];
+    uint8_t _fill = 0;                  // block being filled by push()
+    uint16_t _count = 0;
+    uint8_t _axis;
+    uint32_t _reportBlocks;
+    volatile bool _busy = false;        // the other block is being analysed
+    Semaphore _ready;
+    VibrationSpectrum _spectrum;        // last result, guarded by a critical section
+    uint32_t _blocksDone = 0;
+    uint32_t _blocksDropped = 0;
+    uint32_t _samplesLost = 0;          // samples of partial blocks thrown away after a gap in the stream
+    uint32_t _lastUs = 0;               // analysis time of the last block
+    uint32_t _maxUs = 0;
+    unsigned char _stack[VIBRATION_STACK_SIZE];
+    Thread _thread;
+
+    void run(void) {
+        VibrationSpectrum spectrum;
+        while (true) {
+            _ready.wait();
+            uint32_t start = us_ticker_read();
+            _analysis.analyze(_blocks[_fill ^ 1], &spectrum);
+            uint32_t elapsed = us_ticker_read() - start;
+            spectrum.block = ++_blocksDone;
+            core_util_critical_section_enter();
+            _spectrum = spectrum;
+            _lastUs = elapsed;
+            if (elapsed > _maxUs) {
+                _maxUs = elapsed;
+            }
+            core_util_critical_section_exit();
+            _busy = false;
+            if (_reportBlocks && spectrum.block % _reportBlocks == 0) {
+                print(spectrum);
+            }
+        }
+    }
+
+public:
+    /*
+     * sampleRate ... rate of push() in Hz
+     * scale ... accelerometer resolution, g per LSB
+     * axis ... 0, 1 or 2 for x, y or z of the samples given to push()
+     * reportBlocks ... print() every reportBlocks-th spectrum from the analysis thread, 0 for none
+     * priority ... of the analysis thread, below the acquisition and output threads
+     */
+    VibrationMonitor(float sampleRate, float scale, uint8_t axis = 2, uint32_t reportBlocks = 0,
+                     osPriority priority = osPriorityLow):
+        _analysis(sampleRate, scale), _axis(axis), _reportBlocks(reportBlocks), _ready(0),
+        _thread(priority, VIBRATION_STACK_SIZE, _stack) {
+        memset(&_spectrum, 0, sizeof(_spectrum));
+    }
+
+    void start(void) {
+        _thread.start(callback(this, &VibrationMonitor::run));
+    }
+
+    /* Analysis thread, e.g. for its stack use */
+    Thread* getThread(void) {
+        return &_thread;
+    }
+
+    /* One raw accel x/y/z sample */
+    void push(const int16_t* accel) {
+        _blocks[_fill][_count] = accel[_axis];
+        if (++_count < N) {
+            return;
+        }
+        _count = 0;
+        if (_busy) {
+            _blocksDropped++;
+            return;
+        }
+        _busy = true;
+        _fill ^= 1;
+        _ready.release();
+    }
+
+    /* Restart the current block after a gap in the sample stream (e.g. a FIFO overflow) */
+    void restart(void) {
+        _samplesLost += _count;
+        _count = 0;
+    }
+
+    /* Copy the last spectrum; returns false if none is newer than `lastBlock` */
+    bool getSpectrum(VibrationSpectrum* out, uint32_t lastBlock = 0) {
+        core_util_critical_section_enter();
+        *out = _spectrum;
+        core_util_critical_section_exit();
+        return out->block > lastBlock;
+    }
+
+    void print(const VibrationSpectrum& spectrum) {
+        float bandHz = _analysis.getSampleRate() / 2 / VIBRATION_BANDS;
+        printf("[VIBRATION] block: %lu rms: %.4f g peak: %.1f Hz %.4f g (analysis %lu us, max %lu us, dropped %lu blocks, lost %lu samples)\r\n",
+            (unsigned long) spectrum.block, spectrum.rms, spectrum.peakHz, spectrum.peakAmplitude,
+            (unsigned long) _lastUs, (unsigned long) _maxUs, (unsigned long) _blocksDropped,
+            (unsigned long) _samplesLost);
+        for (int i = 0; i < VIBRATION_BANDS; i++) {
+            printf("[VIBRATION] %6.0f..%6.0f Hz: %.6f g^2\r\n", i * bandHz, (i + 1) * bandHz, spectrum.bands[i]);
+        }
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "mbed.h"
+#include "mpu-9250/MPU9250.hpp"
+
+// Switches an MPU9250 between full-rate acquisition and the low-power wake-on-motion mode.
+//
+// In full-rate mode update() is fed every accel/gyro sample; when neither the acceleration changed by more than the
+// wake threshold between two samples nor the rotation rate exceeded the gyro threshold for the idle period, the
+// sensor enters wake-on-motion mode. waitForMotion() then blocks the calling thread, so the MCU sleeps in the idle
+// thread, until the INT pin signals motion, and restores full-rate acquisition.
+// The INT pin must be wired to `intPin`.
+class WakeOnMotion {
+    MPU9250* _sensor;
+    InterruptIn _int;
+    Semaphore _wake;
+    Timer _idle;                        // time since the last motion
+    uint32_t _idleTimeoutMs;
+    uint16_t _thresholdMg;
+    uint8_t _odr;
+    float _thresholdAccel;              // m/s2, same as _thresholdMg
+    float _thresholdGyro;               // rad/s
+    float _lastAccel[3] = {0, 0, 0};
+    uint32_t _wakeups = 0;
+
+    void onInterrupt(void) {
+        _wake.release();
+    }
+
+public:
+    /*
+     * idleTimeoutMs ... time without motion before entering low power
+     * thresholdMg ... wake-on-motion threshold, also used as the idle threshold on accel changes
+     * odr ... accelerometer rate in low power (LPAccelODR)
+     * thresholdGyro ... rotation rate (rad/s) below which the sensor is considered idle
+     */
+    WakeOnMotion(MPU9250* sensor, PinName intPin, uint32_t idleTimeoutMs = 30000, uint16_t thresholdMg = 40,
+                 uint8_t odr = LP_ACCEL_ODR_15_63HZ, float thresholdGyro = 0.05f):
+        _sensor(sensor), _int(intPin), _wake(0), _idleTimeoutMs(idleTimeoutMs), _thresholdMg(thresholdMg), _odr(odr),
+        _thresholdAccel(thresholdMg * G / 1000.0f), _thresholdGyro(thresholdGyro) {
+        _int.rise(callback(this, &WakeOnMotion::onInterrupt));
+        _idle.start();
+    }
+
+    /*
+     * Feed the output of MPU9250::getAccelGyro(); enters low power after the idle period.
+     * Returns true if the sensor is now in wake-on-motion mode.
+     */
+    bool update(const uint8_t* accelGyro) {
+        bool moving = false;
+        for (int i = 0; i < 3; i++) {
+            float a = MPU9250::outputToFloat(accelGyro, i);
+            float g = MPU9250::outputToFloat(accelGyro, 3 + i);
+            moving |= fabsf(a - _lastAccel[i]) > _thresholdAccel || fabsf(g) > _thresholdGyro;
+            _lastAccel[i] = a;
+        }
+        if (moving) {
+            _idle.reset();
+        } else if ((uint32_t) _idle.read_ms() >= _idleTimeoutMs) {
+            enterLowPower();
+            return true;
+        }
+        return false;
+    }
+
+    void enterLowPower(void) {
+        while (_wake.wait(0) > 0); // Drop edges of the data ready interrupt
+        _sensor->enableWakeOnMotion(_thresholdMg, _odr);
+    }
+
+    /*
+     * Block until the sensor reports motion, then restore full-rate acquisition.
+     * Returns immediately if the sensor is not in wake-on-motion mode.
+     */
+    void waitForMotion(void) {
+        if (!_sensor->isWakeOnMotion()) {
+            return;
+        }
+        // The interrupt is latched; an edge before the wait is still pending in the semaphore
+        _wake.wait();
+        _sensor->disableWakeOnMotion();
+        _idle.reset();
+        _wakeups++;
+    }
+
+    bool isLowPower(void) {
+        return _sensor->isWakeOnMotion();
+    }
+
+    uint32_t getWakeupCount(void) {
+        return _wakeups;
+    }
+};
@@ -0,0 +1,359 @@
+#include "mpu-9250/benchmark.hpp"
+
+#if MPU9250_BENCHMARK
+
+#include "mpu-9250/cycle_counter.hpp"
+#include "mpu-9250/fft.hpp"
+#include "mpu-9250/orientation.hpp"
+#include "mpu-9250/madgwick.hpp"
+#include "mpu-9250/sample_codec.hpp"
+#include "mpu-9250/text_format.hpp"
+
+#define BENCHMARK_FRAMES 400 // 2 seconds of raw frames at 200 Hz
+#define BENCHMARK_FILTERS 8  // independent filters advanced per batch call
+#define BENCHMARK_FIXED_MAX_ANGLE 2.0f  // (deg) accepted rotation between the fixed-point and the float quaternion
+#define BENCHMARK_TRANSFORM_MAX_ACCEL 0.001f // (m/s2) accepted difference of the driver's fixed-point and float conversion
+#define BENCHMARK_TRANSFORM_MAX_GYRO 0.001f  // (rad/s)
+#define BENCHMARK_TRANSFORM_MAX_MAG 0.5f     // (mG)
+
+static SampleFrame benchmark_frames[BENCHMARK_FRAMES];
+
+static void capture_frames(MPU9250* sensor) {
+    for (int i = 0; i < BENCHMARK_FRAMES; i++) {
+        sensor->readRawFrame(&benchmark_frames[i]);
+        wait_ms(5);
+    }
+}
+
+static void benchmark_sample_codec(void) {
+    static SampleEncoder<> encoder;
+    SampleDecoder decoder;
+    SampleFrame frame;
+    const uint8_t* block;
+    size_t length, encoded = 0;
+    uint32_t start, encode_cycles = 0, decode_cycles = 0;
+    int checked = 0, mismatches = 0;
+
+    encoder.reset();
+    for (int i = 0; i < BENCHMARK_FRAMES; ) {
+        start = cycle_counter_read();
+        bool appended = encoder.append(benchmark_frames[i]);
+        encode_cycles += cycle_counter_read() - start;
+        if (appended && ++i < BENCHMARK_FRAMES) {
+            continue;
+        }
+
+        // Block is full or all frames are consumed
+        start = cycle_counter_read();
+        block = encoder.finish(&length);
+        encode_cycles += cycle_counter_read() - start;
+        encoded += length;
+
+        start = cycle_counter_read();
+        decoder.begin(block, length);
+        while (decoder.next(&frame));
+        decode_cycles += cycle_counter_read() - start;
+
+        // Verify the round trip outside of the measured section
+        decoder.begin(block, length);
+        while (decoder.next(&frame)) {
+            if (memcmp(&frame, &benchmark_frames[checked++], sizeof(frame)) != 0) {
+                mismatches++;
+            }
+        }
+        encoder.reset();
+    }
+
+    size_t raw = BENCHMARK_FRAMES * sizeof(SampleFrame);
+    printf("[CODEC] frames: %d raw: %u bytes encoded: %u bytes ratio: %.2f\r\n",
+        BENCHMARK_FRAMES, (unsigned) raw, (unsigned) encoded, (float) raw / (float) encoded);
+    printf("[CODEC] encode: %lu cycles/sample decode: %lu cycles/sample (%lu cycles per 200 Hz period)\r\n",
+        (unsigned long) (encode_cycles / BENCHMARK_FRAMES), (unsigned long) (decode_cycles / BENCHMARK_FRAMES),
+        (unsigned long) (SystemCoreClock / 200));
+    printf("[CODEC] verified: %d frames mismatches: %d\r\n", checked, mismatches);
+}
+
+// Scale a raw frame with the default full scale ranges; fusion only needs consistent units
+static void frame_to_float(const SampleFrame& frame, float* a, float* g, float* m) {
+    for (int i = 0; i < 3; i++) {
+        a[i] = frame.values[FRAME_ACCEL_X + i] * (2.0f / 32768.0f);
+        g[i] = frame.values[FRAME_GYRO_X + i] * (500.0f / 32768.0f) * DEG_TO_RAD;
+        m[i] = frame.values[FRAME_MAG_X + i] * (10.0f * 4912.0f / 32760.0f);
+    }
+}
+
+// Same scaling in Q5.26; mag is only used as a direction and stays in raw counts
+static void frame_to_fixed(const SampleFrame& frame, fx_t* a, fx_t* g, int32_t* m) {
+    static const fx_t G_RES = fx_from_float((500.0f / 32768.0f) * DEG_TO_RAD);
+    for (int i = 0; i < 3; i++) {
+        a[i] = frame.values[FRAME_ACCEL_X + i] * fx_from_float(2.0f / 32768.0f);
+        g[i] = frame.values[FRAME_GYRO_X + i] * G_RES;
+        m[i] = frame.values[FRAME_MAG_X + i];
+    }
+}
+
+// Replay the captured frames through the float and the fixed-point filter and compare the results
+static void benchmark_fixed_point(void) {
+    float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    fx_t q_fx[4] = {FX_ONE, 0, 0, 0};
+    float a[3], g[3], m[3];
+    fx_t a_fx[3], g_fx[3];
+    int32_t m_fx[3];
+    const fx_t deltat_fx = fx_from_float(0.005f);
+    uint32_t start, float_cycles = 0, fixed_cycles = 0;
+    float max_error = 0.0f, max_angle = 0.0f;
+
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+        frame_to_float(benchmark_frames[n], a, g, m);
+        frame_to_fixed(benchmark_frames[n], a_fx, g_fx, m_fx);
+
+        start = cycle_counter_read();
+        MadgwickQuaternionUpdate(q, 0.005f, -a[1], -a[0], a[2], g[1], g[0], -g[2], m[0], m[1], m[2]);
+        float_cycles += cycle_counter_read() - start;
+
+        start = cycle_counter_read();
+        MadgwickQuaternionUpdateFixed(q_fx, deltat_fx, -a_fx[1], -a_fx[0], a_fx[2], g_fx[1], g_fx[0], -g_fx[2], m_fx[0], m_fx[1], m_fx[2]);
+        fixed_cycles += cycle_counter_read() - start;
+
+        float dot = 0.0f;
+        for (int j = 0; j < 4; j++) {
+            float v = fx_to_float(q_fx[j]);
+            max_error = fmaxf(max_error, fabsf(v - q[j]));
+            dot += v * q[j];
+        }
+        // Rotation angle between both estimates
+        max_angle = fmaxf(max_angle, 2.0f * acosf(fminf(fabsf(dot), 1.0f)) / DEG_TO_RAD);
+    }
+
+    printf("[FIXED] float: %lu cycles/update fixed: %lu cycles/update\r\n",
+        (unsigned long) (float_cycles / BENCHMARK_FRAMES), (unsigned long) (fixed_cycles / BENCHMARK_FRAMES));
+    printf("[FIXED] max |q_fixed - q_float|: %f max angle: %f deg (limit %.1f deg): %s\r\n", max_error, max_angle,
+        BENCHMARK_FIXED_MAX_ANGLE, max_angle <= BENCHMARK_FIXED_MAX_ANGLE ? "PASS" : "FAIL");
+}
+
+#if MPU9250_FUSION_FIXED_POINT
+// Driver conversion of one raw frame in the Q-format build against its float reference, largest error per channel
+static void compare_transform(MPU9250* sensor, const SampleFrame& frame, float* max_error, int* saturated) {
+    int16_t raw[6], mag[3];
+    uint8_t out[4 * 6], mag_out[4 * 3];
+    float accel[3], gyro[3], mag_ref[3];
+
+    for (int i = 0; i < 3; i++) {
+        raw[i] = frame.values[FRAME_ACCEL_X + i];
+        raw[3 + i] = frame.values[FRAME_GYRO_X + i];
+        mag[i] = frame.values[FRAME_MAG_X + i];
+    }
+    sensor->transformAccelGyro(raw, out);
+    sensor->transformMag(mag, mag_out);
+    sensor->convertAccelGyro(raw, accel, gyro);
+    sensor->convertMag(mag, mag_ref);
+
+    for (int i = 0; i < 3; i++) {
+        max_error[0] = fmaxf(max_error[0], fabsf(MPU9250::outputToFloat(out, i) - G * accel[i]));
+        max_error[1] = fmaxf(max_error[1], fabsf(MPU9250::outputToFloat(out, 3 + i) - gyro[i]));
+        // The Q15.16 mag output saturates at +-32768 mG
+        float limited = fminf(fmaxf(mag_ref[i], -32768.0f), 32767.99998f);
+        if (limited != mag_ref[i]) {
+            (*saturated)++;
+        }
+        max_error[2] = fmaxf(max_error[2], fabsf(MPU9250::outputToFloat(mag_out, i) - limited));
+    }
+}
+#endif
+
+// Replay the captured frames and both full scale ends through the driver's sample conversion
+static void benchmark_transform(MPU9250* sensor) {
+#if MPU9250_FUSION_FIXED_POINT
+    float max_error[3] = {0.0f, 0.0f, 0.0f};
+    int saturated = 0;
+    SampleFrame frame;
+
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+        compare_transform(sensor, benchmark_frames[n], max_error, &saturated);
+    }
+    for (int n = 0; n < 2; n++) {
+        for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+            frame.values[i] = n ? INT16_MAX : INT16_MIN;
+        }
+        compare_transform(sensor, frame, max_error, &saturated);
+    }
+
+    bool pass = max_error[0] <= BENCHMARK_TRANSFORM_MAX_ACCEL && max_error[1] <= BENCHMARK_TRANSFORM_MAX_GYRO &&
+        max_error[2] <= BENCHMARK_TRANSFORM_MAX_MAG;
+    printf("[TRANSFORM] max |fixed - float| accel: %f m/s2 gyro: %f rad/s mag: %f mG (limits %.3f %.3f %.1f), "
+        "mag saturated: %d: %s\r\n", max_error[0], max_error[1], max_error[2], BENCHMARK_TRANSFORM_MAX_ACCEL,
+        BENCHMARK_TRANSFORM_MAX_GYRO, BENCHMARK_TRANSFORM_MAX_MAG, saturated, pass ? "PASS" : "FAIL");
+#else
+    (void) sensor;
+    printf("[TRANSFORM] float build, no fixed-point conversion to compare\r\n");
+#endif
+}
+
+static void benchmark_madgwick_batch(void) {
+    static MadgwickBatchInput<BENCHMARK_FILTERS> input;
+    static MadgwickBatch<BENCHMARK_FILTERS> batch;
+    float q[BENCHMARK_FILTERS][4];
+    float a[3], g[3], m[3], batch_q[4];
+    uint32_t start, scalar_cycles = 0, batch_cycles = 0;
+    float max_error = 0.0f;
+
+    batch.reset();
+    for (int i = 0; i < BENCHMARK_FILTERS; i++) {
+        q[i][0] = 1.0f;
+        q[i][1] = q[i][2] = q[i][3] = 0.0f;
+    }
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+        // Each filter replays the capture from a different offset
+        for (int i = 0; i < BENCHMARK_FILTERS; i++) {
+            frame_to_float(benchmark_frames[(n + i * 7) % BENCHMARK_FRAMES], a, g, m);
+            input.ax[i] = -a[1];
+            input.ay[i] = -a[0];
+            input.az[i] = a[2];
+            input.gx[i] = g[1];
+            input.gy[i] = g[0];
+            input.gz[i] = -g[2];
+            input.mx[i] = m[0];
+            input.my[i] = m[1];
+            input.mz[i] = m[2];
+            input.deltat[i] = 0.005f;
+        }
+
+        start = cycle_counter_read();
+        for (int i = 0; i < BENCHMARK_FILTERS; i++) {
+            MadgwickQuaternionUpdate(q[i], input.deltat[i], input.ax[i], input.ay[i], input.az[i],
+                input.gx[i], input.gy[i], input.gz[i], input.mx[i], input.my[i], input.mz[i]);
+        }
+        scalar_cycles += cycle_counter_read() - start;
+
+        start = cycle_counter_read();
+        batch.update(input);
+        batch_cycles += cycle_counter_read() - start;
+    }
+
+    for (int i = 0; i < BENCHMARK_FILTERS; i++) {
+        batch.getQuaternion(i, batch_q);
+        for (int j = 0; j < 4; j++) {
+            max_error = fmaxf(max_error, fabsf(batch_q[j] - q[i][j]));
+        }
+    }
+
+    uint32_t updates = BENCHMARK_FRAMES * BENCHMARK_FILTERS;
+    printf("[MADGWICK] filters: %d scalar: %lu cycles/update batch: %lu cycles/update speedup: %.2f\r\n",
+        BENCHMARK_FILTERS, (unsigned long) (scalar_cycles / updates), (unsigned long) (batch_cycles / updates),
+        (float) scalar_cycles / (float) batch_cycles);
+    printf("[MADGWICK] max |q_batch - q_scalar|: %f\r\n", max_error);
+}
+
+// Format the accel/gyro/mag lines of every frame with snprintf() and with TextBuffer and compare the text
+static void benchmark_text_format(void) {
+    static char expected[256];
+    static TextBuffer<> text;
+    float a[3], g[3], m[3];
+    uint32_t start, printf_cycles = 0, text_cycles = 0;
+    int mismatches = 0;
+
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+        frame_to_float(benchmark_frames[n], a, g, m);
+
+        start = cycle_counter_read();
+        int length = snprintf(expected, sizeof(expected),
+            "[ACCEL (m/s2)] x:%11.6f y:%11.6f z:%11.6f\r\n"
+            "[GYRO (rad/s)] x:%11.6f y:%11.6f z:%11.6f\r\n"
+            "[MAG (mG)    ] x:%11.6f y:%11.6f z:%11.6f\r\n",
+            a[0], a[1], a[2], g[0], g[1], g[2], m[0], m[1], m[2]);
+        printf_cycles += cycle_counter_read() - start;
+
+        start = cycle_counter_read();
+        text.reset();
+        static const char* labels[3] = {"[ACCEL (m/s2)] x:", "[GYRO (rad/s)] x:", "[MAG (mG)    ] x:"};
+        const float* values[3] = {a, g, m};
+        for (int i = 0; i < 3; i++) {
+            text.append(labels[i]);
+            text.appendFloat(values[i][0], 11);
+            text.append(" y:");
+            text.appendFloat(values[i][1], 11);
+            text.append(" z:");
+            text.appendFloat(values[i][2], 11);
+            text.append("\r\n");
+        }
+        text_cycles += cycle_counter_read() - start;
+
+        if ((size_t) length != text.length() || memcmp(expected, text.data(), length) != 0) {
+            mismatches++;
+        }
+    }
+
+    printf("[TEXT] snprintf: %lu cycles/sample formatter: %lu cycles/sample speedup: %.2f\r\n",
+        (unsigned long) (printf_cycles / BENCHMARK_FRAMES), (unsigned long) (text_cycles / BENCHMARK_FRAMES),
+        (float) printf_cycles / (float) text_cycles);
+    printf("[TEXT] samples: %d mismatches: %d\r\n", BENCHMARK_FRAMES, mismatches);
+}
+
+// Spectrum of the captured accel z samples; only the cost matters, the frames are captured at 200 Hz
+static void benchmark_fft(void) {
+    static VibrationAnalysis<256> analysis(200.0f, 2.0f / 32768.0f);
+    static int16_t block[256];
+    VibrationSpectrum spectrum;
+    uint32_t start, cycles = 0;
+    const int blocks = BENCHMARK_FRAMES - 256;
+
+    for (int n = 0; n < blocks; n++) {
+        for (int i = 0; i < 256; i++) {
+            block[i] = benchmark_frames[n + i].values[FRAME_ACCEL_Z];
+        }
+        start = cycle_counter_read();
+        analysis.analyze(block, &spectrum);
+        cycles += cycle_counter_read() - start;
+    }
+    printf("[FFT] N: 256 %lu cycles/block (%lu cycles per 64 ms block period at 4 kHz)\r\n",
+        (unsigned long) (cycles / blocks), (unsigned long) (SystemCoreClock / 1000 * 64));
+}
+
+// Euler angles of the fused captured frames with libm and with the polynomial approximations
+static void benchmark_derived(void) {
+    DerivedOrientation precise(false), fast(true);
+    float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    float a[3], g[3], m[3], accel[3];
+    uint32_t start, precise_cycles = 0, fast_cycles = 0;
+    float max_error = 0.0f;
+
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+        frame_to_float(benchmark_frames[n], a, g, m);
+        MadgwickQuaternionUpdate(q, 0.005f, -a[1], -a[0], a[2], g[1], g[0], -g[2], m[0], m[1], m[2]);
+        accel[0] = -a[1];
+        accel[1] = -a[0];
+        accel[2] = a[2];
+        precise.update(q, accel, n + 1);
+        fast.update(q, accel, n + 1);
+
+        start = cycle_counter_read();
+        const float* e1 = precise.getEuler();
+        precise_cycles += cycle_counter_read() - start;
+        start = cycle_counter_read();
+        const float* e2 = fast.getEuler();
+        fast_cycles += cycle_counter_read() - start;
+
+        for (int i = 0; i < 3; i++) {
+            float d = fabsf(e1[i] - e2[i]);
+            max_error = fmaxf(max_error, fminf(d, 2.0f * PI - d));
+        }
+    }
+
+    printf("[DERIVED] DCM and euler libm: %lu cycles/sample fast: %lu cycles/sample max difference: %f deg\r\n",
+        (unsigned long) (precise_cycles / BENCHMARK_FRAMES), (unsigned long) (fast_cycles / BENCHMARK_FRAMES),
+        max_error / DEG_TO_RAD);
+}
+
+void mpu9250_benchmark(MPU9250* sensor) {
+    cycle_counter_init();
+    capture_frames(sensor);
+    benchmark_sample_codec();
+    benchmark_madgwick_batch();
+    benchmark_fixed_point();
+    benchmark_transform(sensor);
+    benchmark_text_format();
+    benchmark_fft();
+    benchmark_derived();
+}
+
+#endif
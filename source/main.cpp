@@ -1,8 +1,14 @@
-#include <memory>
 #include "mbed.h"
 #include "mpu-9250/motion_sync.hpp"
 
-static auto pc = std::make_shared<Serial>(USBTX, USBRX);
+#ifndef BLINKY_STACK_SIZE
+#define BLINKY_STACK_SIZE 512
+#endif
+
+// Serial port and thread stacks, in static storage with MPU9250_STATIC_ALLOCATION=1
+static StaticObject<Serial> pc;
+static ThreadStack<BLINKY_STACK_SIZE> blinky_stack;
+static ThreadStack<MPU9250_SYNC_STACK_SIZE> mpu9250_stack;
 
 static void blinky(void) {
     static DigitalOut led(LED1);
@@ -20,12 +26,20 @@ static void mpu9250_task(void) {
 }
 
 int main(int, char**) {
-    pc->baud(115200);
+    pc.create(USBTX, USBRX)->baud(115200);
 
     mpu9250_sync_task_init();
 
-    Thread blinky_task(blinky);
-    Thread mpu9250_sync_task(mpu9250_task);
+    Thread blinky_task(osPriorityNormal, BLINKY_STACK_SIZE, blinky_stack.get());
+    Thread mpu9250_sync_task(osPriorityNormal, MPU9250_SYNC_STACK_SIZE, mpu9250_stack.get());
+    MemoryBudget* budget = mpu9250_memory_budget();
+    budget->addObject("serial", sizeof(Serial));
+    budget->addObject("blinky stack", BLINKY_STACK_SIZE);
+    budget->addObject("sync stack", MPU9250_SYNC_STACK_SIZE);
+    budget->addThread("blinky", &blinky_task);
+    budget->addThread("sync", &mpu9250_sync_task);
+    blinky_task.start(blinky);
+    mpu9250_sync_task.start(mpu9250_task);
     mpu9250_sync_task.join();
     return 0;
 }
@@ -1,11 +1,266 @@
 #include "mpu-9250/motion_sync.hpp"
+#include "mpu-9250/benchmark.hpp"
+#include "mpu-9250/sample_codec.hpp"
+#include "mpu-9250/loop_monitor.hpp"
+#include "mpu-9250/wake_on_motion.hpp"
+#include "mpu-9250/health.hpp"
+#include "mpu-9250/bias_table.hpp"
+#include "mpu-9250/bias_store.hpp"
+#include "mpu-9250/text_format.hpp"
+#include "mpu-9250/vibration.hpp"
+#include "mpu-9250/orientation.hpp"
+#include "mpu-9250/sample_hub.hpp"
+#include "mpu-9250/memory_budget.hpp"
+#include "mpu-9250/rate_control.hpp"
 
-// I2C1 port, I2C Bus 1
-static I2C i2c(PB_9, PB_8);
+// I2C1 port, I2C Bus 1, shared with any other peripheral through the bus manager
+static I2CBus i2c_bus(PB_9, PB_8, 1);
 
-// MPU9250
+// MPU9250, in static storage with MPU9250_STATIC_ALLOCATION=1 like the other objects created by mpu9250_sync_task_init()
+static StaticObject<MPU9250> motion_sensor_object;
 static MPU9250* motion_sensor;
 
+static MemoryBudget memory_budget;
+
+MemoryBudget* mpu9250_memory_budget(void) {
+    return &memory_budget;
+}
+
+// Data-ready period of the sensor, 200 Hz (SMPLRT_DIV = 4 in MPU9250::initMPU9250())
+#define MPU9250_SAMPLE_PERIOD_US 5000
+
+// Print and restart the loop timing every LOOP_MONITOR_REPORT_ITERATIONS iterations
+#ifndef LOOP_MONITOR_REPORT_ITERATIONS
+#define LOOP_MONITOR_REPORT_ITERATIONS 500
+#endif
+
+static LoopMonitor loop_monitor(MPU9250_SAMPLE_PERIOD_US);
+
+#if MPU9250_WAKE_ON_MOTION
+static StaticObject<WakeOnMotion> wake_on_motion_object;
+static WakeOnMotion* wake_on_motion;
+#endif
+
+// Human-readable output; without MPU9250_PRINTF_OUTPUT each block is collected in text_line and written at once
+#if !MPU9250_PRINTF_OUTPUT
+static TextBuffer<> text_line;
+#endif
+static bool output_enabled = true;      // text of this sample is printed, see MPU9250_OUTPUT_DIVIDER
+
+static void output_text(const char* text) {
+    if (!output_enabled) {
+        return;
+    }
+#if MPU9250_PRINTF_OUTPUT
+    printf("%s", text);
+#else
+    text_line.append(text);
+#endif
+}
+
+#if MPU9250_HEALTH_CHECK
+static void output_hex(uint32_t value, uint8_t digits) {
+    if (!output_enabled) {
+        return;
+    }
+#if MPU9250_PRINTF_OUTPUT
+    printf("%0*lX", digits, (unsigned long) value);
+#else
+    text_line.appendHex(value, digits);
+#endif
+}
+#endif
+
+// "<label> x:<value> y:<value> z:<value>" for values first.. of an output buffer (float or Q15.16), one per axis name
+static void output_values(const char* label, const uint8_t* byte_vals, int first, const char* axes, uint8_t last_width) {
+    if (!output_enabled) {
+        return;
+    }
+    output_text(label);
+    for (int i = 0; axes[i]; i++) {
+        uint8_t width = axes[i + 1] ? 11 : last_width;
+        char name[4] = {' ', axes[i], ':', 0};
+        output_text(name);
+#if MPU9250_PRINTF_OUTPUT
+        printf("%*.6f", width, MPU9250::outputToFloat(byte_vals, first + i));
+#elif MPU9250_FUSION_FIXED_POINT
+        text_line.appendQ16(((const int32_t*) byte_vals)[first + i], width);
+#else
+        text_line.appendFloat(((const float*) byte_vals)[first + i], width);
+#endif
+    }
+    output_text("\r\n");
+}
+
+#if MPU9250_DERIVED_OUTPUT || MPU9250_SAMPLE_HUB
+// Same for float values that are not part of an output buffer
+static void output_floats(const char* label, const float* values, const char* axes, uint8_t last_width = 11) {
+    if (!output_enabled) {
+        return;
+    }
+    output_text(label);
+    for (int i = 0; axes[i]; i++) {
+        uint8_t width = axes[i + 1] ? 11 : last_width;
+        char name[4] = {' ', axes[i], ':', 0};
+        output_text(name);
+#if MPU9250_PRINTF_OUTPUT
+        printf("%*.6f", width, values[i]);
+#else
+        text_line.appendFloat(values[i], width);
+#endif
+    }
+    output_text("\r\n");
+}
+#endif
+
+#if MPU9250_VIBRATION && !MPU9250_SAMPLE_HUB && !MPU9250_PRINTF_OUTPUT
+static void mpu9250_collect_vibration(MPU9250* sensor);
+#endif
+
+static void output_flush(void) {
+#if MPU9250_VIBRATION && !MPU9250_SAMPLE_HUB && !MPU9250_PRINTF_OUTPUT
+    // The text of a sample takes longer at 115200 baud than the FIFO holds at 4 kHz, so it is written in pieces of
+    // whole lines with the FIFO drained in between
+    const char* text = text_line.data();
+    size_t length = text_line.length();
+    for (size_t i = 0; i < length; ) {
+        size_t end = i + MPU9250_VIBRATION_TEXT_CHUNK < length ? i + MPU9250_VIBRATION_TEXT_CHUNK : length;
+        size_t line = end;
+        while (line > i && text[line - 1] != '\n') {
+            line--;
+        }
+        end = line > i && end < length ? line : end;
+        fwrite(&text[i], 1, end - i, stdout);
+        fflush(stdout);
+        mpu9250_collect_vibration(motion_sensor);
+        i = end;
+    }
+    text_line.reset();
+#elif !MPU9250_PRINTF_OUTPUT
+    text_line.flush();
+#endif
+}
+
+#if MPU9250_HEALTH_CHECK
+// Called by the acquisition thread before a report is printed with printf. In the hub build the sample text belongs
+// to the output thread and is left alone.
+static void output_before_report(void) {
+#if !MPU9250_SAMPLE_HUB
+    output_flush();
+#endif
+}
+#endif
+
+#if MPU9250_HEALTH_CHECK
+static void output_health(uint16_t flags) {
+    output_text("[HEALTH      ] flags: 0x");
+    output_hex(flags, 4);
+    output_text("\r\n");
+}
+#endif
+
+#if MPU9250_HEALTH_CHECK
+static StaticObject<HealthMonitor> health_monitor_object;
+static HealthMonitor* health_monitor;
+
+// Returns false for samples taken during the self-test, which must not be used
+static bool mpu9250_check_health(uint16_t* flags) {
+    static uint32_t self_tests = 0;
+    *flags = health_monitor->update();
+    const HealthStatus& status = health_monitor->getStatus();
+    if (status.selfTests != self_tests) {
+        self_tests = status.selfTests;
+        output_before_report();
+        health_monitor->print();
+    }
+    return !(*flags & HEALTH_SELF_TEST_RUNNING);
+}
+#endif
+
+#if MPU9250_TEMP_COMPENSATION
+static TempBiasTable bias_table;
+static BiasLearner bias_learner(&bias_table);
+#if DEVICE_FLASH
+static BiasTableStore bias_store;
+static TempBiasTable bias_snapshot;     // copy written by the save thread
+static bool bias_save_due = false;      // the table changed and the save interval passed
+static volatile bool bias_saving = false;
+static Semaphore bias_save_request(0);
+static unsigned char bias_save_stack[MPU9250_BIAS_SAVE_STACK_SIZE];
+static Thread bias_save_thread(osPriorityLow, MPU9250_BIAS_SAVE_STACK_SIZE, bias_save_stack);
+
+// Erasing the flash sector takes seconds, so the table is written by a low-priority thread
+static void mpu9250_bias_save_task(void) {
+    Timer timer;
+    while (true) {
+        bias_save_request.wait();
+        timer.reset();
+        timer.start();
+        bool saved = bias_store.save(bias_snapshot);
+        printf("[BIAS] table %s in %d ms\r\n", saved ? "saved" : "not saved", timer.read_ms());
+        bias_saving = false;
+    }
+}
+
+// Hand a copy of the table to the save thread if a save is due and the previous one has finished
+static void mpu9250_save_bias(void) {
+    if (!bias_save_due || bias_saving) {
+        return;
+    }
+    bias_save_due = false;
+    bias_saving = true;
+    bias_snapshot = bias_table;
+    bias_save_request.release();
+}
+#endif
+
+// Feed the learner with the sample just read and save the table once in a while when it changed. With
+// MPU9250_WAKE_ON_MOTION the save waits until the sensor enters low power.
+static void mpu9250_learn_bias(MPU9250* sensor) {
+    static bool changed = false;
+    static Timer save_timer;
+    float gyro[3], accel[3], temp;
+    sensor->getBiasSample(gyro, accel, &temp);
+    if (bias_learner.update(gyro, accel, temp)) {
+        printf("[BIAS] learned at %.1f degC (%lu windows)\r\n", temp, (unsigned long) bias_learner.getLearnedCount());
+        if (!changed) {
+            changed = true;
+            save_timer.reset();
+            save_timer.start();
+        }
+    }
+#if DEVICE_FLASH
+    if (changed && (uint32_t) save_timer.read_ms() >= MPU9250_BIAS_SAVE_INTERVAL_MS) {
+        changed = false;
+        bias_save_due = true;
+    }
+#if !MPU9250_WAKE_ON_MOTION
+    mpu9250_save_bias();
+#endif
+#endif
+}
+#endif
+
+#if MPU9250_VIBRATION
+static StaticObject<VibrationMonitor<> > vibration_object;
+static VibrationMonitor<>* vibration;
+
+// Move the accelerometer FIFO into the vibration monitor; its analysis thread prints the spectrum
+static void mpu9250_collect_vibration(MPU9250* sensor) {
+    int16_t accel[3 * MPU9250_FIFO_BURST];
+    int count;
+    do {
+        count = sensor->readAccelFifo(accel, MPU9250_FIFO_BURST);
+        if (count < 0) {
+            vibration->restart();
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            vibration->push(&accel[3 * i]);
+        }
+    } while (count == MPU9250_FIFO_BURST);
+}
+#endif
 
 static void mpu9250_init(MPU9250* sensor) {
     if (sensor->whoAmI1() != 0x71) {
@@ -19,12 +274,36 @@ static void mpu9250_init(MPU9250* sensor) {
         353.871  // +Down(-Up) (mG)
     );
     sensor->initAll();
+#if MPU9250_VIBRATION
+    sensor->enableAccelFifo();
+#endif
+#if MPU9250_BENCHMARK
+    mpu9250_benchmark(sensor);
+#endif
+}
+
+// Bring a faulty sensor back without the calibration of mpu9250_init()
+static void mpu9250_recover(MPU9250* sensor) {
+    printf("MPU-9250 I2C error (%lu errors), recovering...\r\n", (unsigned long) sensor->getIOErrorCount());
+    if (sensor->recover()) {
+        printf("MPU-9250 recovered\r\n");
+    }
 }
 
 static bool mpu9250_collect_data(MPU9250* sensor, uint8_t *data_store) {
     if (sensor->isInitialized()) {
-        sensor->getAccelGyro(data_store); // float [0:5]
+#if MPU9250_ASYNC_I2C
+        bool ready = sensor->getAccelGyroAsync(data_store); // float [0:5], the conversion overlaps the next read
+        loop_monitor.mark(LOOP_STAGE_READ);
+        return ready;
+#else
+        int16_t raw[6];
+        sensor->readAccelGyroData(raw);
+        loop_monitor.mark(LOOP_STAGE_READ);
+        sensor->transformAccelGyro(raw, data_store); // float [0:5]
+        loop_monitor.mark(LOOP_STAGE_CONVERT);
         return true;
+#endif
     } else {
         mpu9250_init(sensor);
         return false;
@@ -33,27 +312,404 @@ static bool mpu9250_collect_data(MPU9250* sensor, uint8_t *data_store) {
 
 static void ak8963_collect_data(MPU9250* sensor, uint8_t *data_store) {
     if (sensor && sensor->isInitialized()) {
-        sensor->getMag(data_store); // float [0:2]
+        int16_t raw[3];
+        sensor->getRawMag(raw);
+        loop_monitor.mark(LOOP_STAGE_READ);
+        sensor->transformMag(raw, data_store); // float [0:2]
+        loop_monitor.mark(LOOP_STAGE_CONVERT);
         sensor->performMadgwickQuaternionUpdate((uint8_t*) &(((float*) data_store)[3])); // float [3:6]
+        loop_monitor.mark(LOOP_STAGE_FUSE);
+    }
+}
+
+#if MPU9250_ADAPTIVE_RATE
+static const RateTier rate_tiers[] = {
+    // name      SMPLRT_DIV DLPF AK8963  gyro (rad/s) accel variance ((m/s2)^2)
+    {"still",    19,        4,   0x02,   0.0f,        0.0f},      // 50 Hz, 20 Hz bandwidth, mag 8 Hz
+    {"normal",   4,         3,   0x06,   0.15f,       0.05f},     // 200 Hz, 41 Hz bandwidth, the rate of initAll()
+    {"fast",     1,         2,   0x06,   2.0f,        4.0f},      // 500 Hz, 92 Hz bandwidth
+};
+
+static StaticObject<RateController> rate_controller_object;
+static RateController* rate_controller;
+#endif
+
+// Skip the iteration until the next sample of the current rate tier is due, or without MPU9250_ADAPTIVE_RATE until
+// the sensor has a new sample, so that a loop faster than the sample rate does not pass the same sample on again
+static bool mpu9250_sample_due(MPU9250* sensor) {
+#if MPU9250_ADAPTIVE_RATE
+    return !sensor->isInitialized() || rate_controller->isDue();
+#else
+    return !sensor->isInitialized() || sensor->isDataReady();
+#endif
+}
+
+#if MPU9250_ADAPTIVE_RATE
+static uint32_t iteration_start;
+#endif
+
+// Start of an iteration; once a sample has been read, every return must go through mpu9250_end_iteration()
+static void mpu9250_begin_iteration(void) {
+    loop_monitor.begin();
+#if MPU9250_ADAPTIVE_RATE
+    iteration_start = us_ticker_read();
+#endif
+}
+
+// Account the iteration to the loop monitor and to the CPU time of the current rate tier
+static void mpu9250_end_iteration(void) {
+    loop_monitor.end();
+#if MPU9250_ADAPTIVE_RATE
+    rate_controller->addWork(us_ticker_read() - iteration_start);
+#endif
+}
+
+#if MPU9250_DERIVED_OUTPUT
+static DerivedOrientation orientation(MPU9250_FAST_TRIG);
+
+// q and accel as returned by MPU9250::getFusionState()
+static void mpu9250_output_derived(const float* q, const float* accel, uint32_t epoch) {
+    float values[3];
+    orientation.update(q, accel, epoch);
+    const float* euler = orientation.getEuler();
+    for (int i = 0; i < 3; i++) {
+        values[i] = euler[i] / DEG_TO_RAD;
+    }
+    output_floats("[EULER (deg) ]", values, "ypr");
+    values[0] = orientation.getHeading();
+    output_floats("[HEADING(deg)]", values, "h");
+    const float* linear = orientation.getLinearAccelNED();
+    for (int i = 0; i < 3; i++) {
+        values[i] = G * linear[i];
+    }
+    output_floats("[LINEAR(m/s2)]", values, "ned");
+}
+#endif
+
+#if MPU9250_LOG_COMPRESSED
+// A finished block is copied out and written in pieces of MPU9250_LOG_CHUNK bytes, one per iteration, while the next
+// block fills, so that the serial output never blocks the loop for a whole block (44 ms for 512 bytes at 115200 baud)
+#define LOG_BLOCK_SIZE 512
+static SampleEncoder<LOG_BLOCK_SIZE> log_encoder;
+static uint8_t log_block[LOG_BLOCK_SIZE];
+static size_t log_length = 0, log_written = 0;
+
+static void mpu9250_log_write(void) {
+    size_t n = log_length - log_written < MPU9250_LOG_CHUNK ? log_length - log_written : MPU9250_LOG_CHUNK;
+    if (n == 0) {
+        return;
     }
+    fwrite(&log_block[log_written], 1, n, stdout);
+    fflush(stdout);
+    log_written += n;
 }
 
+// Log each new sample once, on the data-ready flag, and write the next piece of the previous block
+static void mpu9250_log_frame(MPU9250* sensor) {
+    if (sensor->isDataReady()) {
+        SampleFrame frame;
+        sensor->readRawFrame(&frame);
+        uint32_t timestamp = us_ticker_read();
+        if (!log_encoder.append(frame, timestamp)) {
+            while (log_written < log_length) {
+                mpu9250_log_write();    // the serial port fell behind the samples
+            }
+            const uint8_t* block = log_encoder.finish(&log_length);
+            memcpy(log_block, block, log_length);
+            log_written = 0;
+            log_encoder.reset();
+            log_encoder.append(frame, timestamp);
+        }
+    }
+    mpu9250_log_write();
+}
+#endif
+
+#if MPU9250_I2C_STATS
+// Print and restart the register I/O statistics every I2C_STATS_REPORT_SAMPLES samples
+#define I2C_STATS_REPORT_SAMPLES 500
+
+static void mpu9250_report_i2c_stats(void) {
+    static uint32_t samples = 0;
+    static I2CStatsSnapshot snapshot; // too large for the task stack
+    if (++samples < I2C_STATS_REPORT_SAMPLES) {
+        return;
+    }
+    samples = 0;
+    i2c_stats_snapshot(&snapshot);
+    i2c_stats_reset();
+    printf("%s\r\n", "--------------------------------------------------------");
+    i2c_stats_print(snapshot);
+    i2c_bus.printStats();
+}
+#endif
+
+// Loop timing and bus statistics, once in a while
+static void mpu9250_report(void) {
+#if MPU9250_LOOP_MONITOR
+    if (loop_monitor.getStats().iterations == LOOP_MONITOR_REPORT_ITERATIONS) {
+        loop_monitor.print();
+        loop_monitor.reset();
+    }
+#endif
+#if MPU9250_I2C_STATS
+    mpu9250_report_i2c_stats();
+#endif
+#if MPU9250_ADAPTIVE_RATE
+    static uint32_t rate_reported = 0;
+    uint32_t now = rate_controller->getElapsedMs();
+    if (now - rate_reported >= MPU9250_RATE_REPORT_MS) {
+        rate_reported = now;
+        rate_controller->print();
+    }
+#endif
+#if MPU9250_MEMORY_REPORT
+    static uint32_t samples = 0;
+    if (++samples == MPU9250_MEMORY_REPORT_SAMPLES) {
+        samples = 0;
+        memory_budget.print();
+    }
+#endif
+}
+
+#if MPU9250_SAMPLE_HUB
+static SampleHub<MotionSample> sample_hub;
+static SampleQueue<MotionSample, MPU9250_OUTPUT_QUEUE_DEPTH> output_queue("output", SUBSCRIBER_DROP_OLDEST,
+    MPU9250_OUTPUT_DIVIDER);
+static unsigned char output_stack[MPU9250_OUTPUT_STACK_SIZE];
+static Thread output_thread(osPriorityBelowNormal, MPU9250_OUTPUT_STACK_SIZE, output_stack);
+
+bool mpu9250_subscribe(SampleSubscriber<MotionSample>* subscriber) {
+    return sample_hub.subscribe(subscriber);
+}
+
+// Text output of the hub build, the only user of the output helpers
+static void mpu9250_output_task(void) {
+    static MotionSample sample;
+    uint32_t sequence, reported = 0;
+    while (true) {
+        output_queue.receive(&sample, osWaitForever, &sequence);
+        output_text("========================================================\r\n");
+#if MPU9250_HEALTH_CHECK
+        output_health(sample.health);
+#endif
+        output_floats("[ACCEL (m/s2)]", sample.accel, "xyz");
+        output_floats("[GYRO (rad/s)]", sample.gyro, "xyz");
+        output_floats("[MAG (mG)    ]", sample.mag, "xyz");
+        output_floats("[QUARTERNION ]", sample.q, "wxyz", 0);
+#if MPU9250_DERIVED_OUTPUT
+        float accel[3];
+        for (int i = 0; i < 3; i++) {
+            accel[i] = -sample.accel[i] / G;    // as fed to the filter, see MPU9250::getFusionState()
+        }
+        mpu9250_output_derived(sample.q, accel, sequence);
+#endif
+        output_flush();
+        if (sequence - reported >= MPU9250_HUB_REPORT_SAMPLES) {
+            reported = sequence;
+            sample_hub.print();
+        }
+    }
+}
+
+// Acquisition of the hub build: read, convert and fuse, then hand the sample to the subscribers without any output
+static void mpu9250_publish_sample(MPU9250* sensor) {
+    uint8_t byte_vals[4 * 7];
+    MotionSample sample;
+    if (!mpu9250_sample_due(sensor)) {
+        return;
+    }
+    mpu9250_begin_iteration();
+    if (!mpu9250_collect_data(sensor, byte_vals)) {
+        return;
+    }
+#if MPU9250_ADAPTIVE_RATE
+    if (rate_controller->update(byte_vals)) {
+        loop_monitor.setPeriod(rate_controller->getPeriodUs());
+    }
+#endif
+    sample.timestamp = us_ticker_read();
+    sample.health = 0;
+#if MPU9250_VIBRATION
+    mpu9250_collect_vibration(sensor);
+    loop_monitor.mark(LOOP_STAGE_READ);
+#endif
+#if MPU9250_HEALTH_CHECK
+    if (!mpu9250_check_health(&sample.health)) {
+        mpu9250_end_iteration();
+        return;
+    }
+#endif
+#if MPU9250_TEMP_COMPENSATION
+    mpu9250_learn_bias(sensor);
+#endif
+    for (int i = 0; i < 3; i++) {
+        sample.accel[i] = MPU9250::outputToFloat(byte_vals, i);
+        sample.gyro[i] = MPU9250::outputToFloat(byte_vals, 3 + i);
+    }
+#if MPU9250_WAKE_ON_MOTION
+    if (wake_on_motion->update(byte_vals)) {
+        printf("MPU-9250 idle, wake on motion\r\n");
+#if MPU9250_TEMP_COMPENSATION && DEVICE_FLASH
+        mpu9250_save_bias();
+#endif
+        mpu9250_end_iteration();
+        return;
+    }
+#endif
+    ak8963_collect_data(sensor, byte_vals);
+    for (int i = 0; i < 3; i++) {
+        sample.mag[i] = MPU9250::outputToFloat(byte_vals, i);
+    }
+    for (int i = 0; i < 4; i++) {
+        sample.q[i] = MPU9250::outputToFloat(byte_vals, 3 + i);
+    }
+    sample_hub.publish(sample);
+    loop_monitor.mark(LOOP_STAGE_OUTPUT);
+    mpu9250_end_iteration();
+    mpu9250_report();
+}
+#else
+bool mpu9250_subscribe(SampleSubscriber<MotionSample>*) {
+    return false;
+}
+#endif
+
 void mpu9250_sync_task(void) {
+    if (motion_sensor->isInitialized() && motion_sensor->hasFault()) {
+        mpu9250_recover(motion_sensor);
+        return;
+    }
+#if MPU9250_WAKE_ON_MOTION
+    if (wake_on_motion->isLowPower()) {
+        wake_on_motion->waitForMotion();
+        loop_monitor.skipInterval();
+        printf("MPU-9250 motion, full rate (wakeup %lu)\r\n", (unsigned long) wake_on_motion->getWakeupCount());
+        return;
+    }
+#endif
+#if MPU9250_LOG_COMPRESSED
+    if (motion_sensor->isInitialized()) {
+        mpu9250_log_frame(motion_sensor);
+    } else {
+        mpu9250_init(motion_sensor);
+    }
+    return;
+#endif
+#if MPU9250_SAMPLE_HUB
+    mpu9250_publish_sample(motion_sensor);
+    return;
+#endif
     uint8_t byte_vals[4 * 7];
-    float* vals;
+    static uint32_t samples = 0;
+    if (!mpu9250_sample_due(motion_sensor)) {
+        return;
+    }
+    mpu9250_begin_iteration();
     if (mpu9250_collect_data(motion_sensor, byte_vals)) {
-        vals = (float*) byte_vals;
-        printf("%s\r\n", "========================================================");
-        printf("[ACCEL (m/s2)] x:%11.6f y:%11.6f z:%11.6f\r\n", vals[0], vals[1], vals[2]);
-        printf("[GYRO (rad/s)] x:%11.6f y:%11.6f z:%11.6f\r\n", vals[3], vals[4], vals[5]);
+        output_enabled = ++samples % MPU9250_OUTPUT_DIVIDER == 0;
+#if MPU9250_ADAPTIVE_RATE
+        if (rate_controller->update(byte_vals)) {
+            loop_monitor.setPeriod(rate_controller->getPeriodUs());
+        }
+#endif
+#if MPU9250_VIBRATION
+        mpu9250_collect_vibration(motion_sensor);
+        loop_monitor.mark(LOOP_STAGE_READ);
+#endif
+        output_text("========================================================\r\n");
+#if MPU9250_HEALTH_CHECK
+        uint16_t flags;
+        if (!mpu9250_check_health(&flags)) {
+            output_text("[SELF-TEST RUNNING]\r\n");
+            output_flush();
+            mpu9250_end_iteration();
+            return;
+        }
+        output_health(flags);
+#endif
+#if MPU9250_TEMP_COMPENSATION
+        mpu9250_learn_bias(motion_sensor);
+#endif
+        output_values("[ACCEL (m/s2)]", byte_vals, 0, "xyz", 11);
+        output_values("[GYRO (rad/s)]", byte_vals, 3, "xyz", 11);
+        loop_monitor.mark(LOOP_STAGE_OUTPUT);
+#if MPU9250_WAKE_ON_MOTION
+        if (wake_on_motion->update(byte_vals)) {
+            // Goes out with the text of this sample, whatever MPU9250_OUTPUT_DIVIDER says
+            output_enabled = true;
+            output_text("MPU-9250 idle, wake on motion\r\n");
+            output_flush();
+#if MPU9250_TEMP_COMPENSATION && DEVICE_FLASH
+            mpu9250_save_bias();
+#endif
+            mpu9250_end_iteration();
+            return;
+        }
+#endif
         ak8963_collect_data(motion_sensor, byte_vals);
-        vals = (float*) byte_vals;
-        printf("[MAG (mG)    ] x:%11.6f y:%11.6f z:%11.6f\r\n", vals[0], vals[1], vals[2]);
-        printf("[QUARTERNION ] w:%11.6f x:%11.6f y:%11.6f z:%f\r\n", vals[3], vals[4], vals[5], vals[6]);
+        output_values("[MAG (mG)    ]", byte_vals, 0, "xyz", 11);
+        output_values("[QUARTERNION ]", byte_vals, 3, "wxyz", 0);
+#if MPU9250_DERIVED_OUTPUT
+        if (output_enabled) {
+            float q[4], accel[3];
+            uint32_t epoch = motion_sensor->getFusionState(q, accel);
+            mpu9250_output_derived(q, accel, epoch);
+        }
+#endif
+        output_flush();
+        loop_monitor.mark(LOOP_STAGE_OUTPUT);
+        mpu9250_end_iteration();
+        mpu9250_report();
     }
 }
 
 void mpu9250_sync_task_init(void) {
-    i2c.frequency(400000);
-    motion_sensor = new MPU9250(&i2c, 1);
+    i2c_bus.frequency(400000);
+    motion_sensor = motion_sensor_object.create(&i2c_bus);
+    memory_budget.addStatic("i2c bus", sizeof(i2c_bus));
+    memory_budget.addObject("sensor", sizeof(MPU9250));
+    memory_budget.addStatic("loop monitor", sizeof(loop_monitor));
+#if !MPU9250_PRINTF_OUTPUT
+    memory_budget.addStatic("text output", sizeof(text_line));
+#endif
+#if MPU9250_WAKE_ON_MOTION
+    wake_on_motion = wake_on_motion_object.create(motion_sensor, MPU9250_INT_PIN, MPU9250_IDLE_TIMEOUT_MS);
+    memory_budget.addObject("wake on mot.", sizeof(WakeOnMotion));
+#endif
+#if MPU9250_HEALTH_CHECK
+    health_monitor = health_monitor_object.create(motion_sensor, MPU9250_SELF_TEST_INTERVAL_MS);
+    memory_budget.addObject("health", sizeof(HealthMonitor));
+#endif
+#if MPU9250_VIBRATION
+    vibration = vibration_object.create(4000.0f, motion_sensor->getAccelResolution(), MPU9250_VIBRATION_AXIS,
+        MPU9250_VIBRATION_REPORT_BLOCKS);
+    vibration->start();
+    memory_budget.addObject("vibration", sizeof(VibrationMonitor<>));   // including the stack of its thread
+    memory_budget.addThread("vibration", vibration->getThread());
+#endif
+#if MPU9250_ADAPTIVE_RATE
+    rate_controller = rate_controller_object.create(motion_sensor, rate_tiers, sizeof(rate_tiers) / sizeof(rate_tiers[0]), 1);
+    memory_budget.addObject("rate control", sizeof(RateController));
+#endif
+#if MPU9250_TEMP_COMPENSATION
+#if DEVICE_FLASH
+    if (bias_store.load(&bias_table)) {
+        printf("[BIAS] table loaded\r\n");
+    }
+    bias_save_thread.start(mpu9250_bias_save_task);
+    memory_budget.addStatic("bias store", sizeof(bias_store) + sizeof(bias_snapshot));
+    memory_budget.addStatic("bias stack", sizeof(bias_save_stack));
+    memory_budget.addThread("bias save", &bias_save_thread);
+#endif
+    motion_sensor->setBiasTable(&bias_table);
+    memory_budget.addStatic("bias table", sizeof(bias_table) + sizeof(bias_learner));
+#endif
+#if MPU9250_SAMPLE_HUB
+    sample_hub.subscribe(&output_queue);
+    output_thread.start(mpu9250_output_task);
+    memory_budget.addStatic("output queue", sizeof(output_queue));
+    memory_budget.addStatic("output stack", sizeof(output_stack));
+    memory_budget.addThread("output", &output_thread);
+#endif
 }
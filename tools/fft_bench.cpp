@@ -0,0 +1,100 @@
+// Host benchmark of the vibration spectrum stage (mpu-9250/fft.hpp).
+//
+//   $ g++ -std=c++11 -O2 -I. -o fft_bench tools/fft_bench.cpp
+//   $ ./fft_bench
+//
+// Checks RealFFT against a direct DFT, analyses a synthetic 4 kHz accelerometer signal (two tones plus noise) and
+// reports the time and, on x86, the TSC cycles per block for the supported block sizes.
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpu-9250/fft.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FFT_BENCH_TSC 1
+#else
+#define FFT_BENCH_TSC 0
+#endif
+
+#define SAMPLE_RATE 4000.0f
+#define SCALE (2.0f / 32768.0f)         // AFS_2G
+#define BLOCKS 2000
+
+// Largest difference between RealFFT and a direct DFT of random input, relative to the largest bin
+template <int N>
+static double check_fft(void) {
+    static RealFFT<N> fft;
+    float data[N];
+    double input[N];
+    for (int i = 0; i < N; i++) {
+        input[i] = data[i] = (float) rand() / RAND_MAX - 0.5f;
+    }
+    fft.forward(data);
+    double maxError = 0.0, maxBin = 0.0;
+    for (int k = 0; k <= N / 2; k++) {
+        double re = 0.0, im = 0.0;
+        for (int n = 0; n < N; n++) {
+            re += input[n] * cos(2.0 * M_PI * k * n / N);
+            im -= input[n] * sin(2.0 * M_PI * k * n / N);
+        }
+        double fr = k == 0 ? data[0] : k == N / 2 ? data[1] : data[2 * k];
+        double fi = k == 0 || k == N / 2 ? 0.0 : data[2 * k + 1];
+        maxError = fmax(maxError, fmax(fabs(fr - re), fabs(fi - im)));
+        maxBin = fmax(maxBin, sqrt(re * re + im * im));
+    }
+    return maxError / maxBin;
+}
+
+template <int N>
+static void bench(void) {
+    static VibrationAnalysis<N> analysis(SAMPLE_RATE, SCALE);
+    static int16_t samples[BLOCKS][N];
+    VibrationSpectrum spectrum;
+
+    // 0.5 g at 440 Hz and 0.1 g at 1230 Hz on top of 1 g gravity, 0.01 g noise
+    for (int b = 0; b < BLOCKS; b++) {
+        for (int i = 0; i < N; i++) {
+            float t = (float) (b * N + i) / SAMPLE_RATE;
+            float g = 1.0f + 0.5f * sinf(2.0f * (float) M_PI * 440.0f * t) + 0.1f * sinf(2.0f * (float) M_PI * 1230.0f * t)
+                + 0.01f * ((float) rand() / RAND_MAX - 0.5f);
+            samples[b][i] = (int16_t) lrintf(g / SCALE);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+#if FFT_BENCH_TSC
+    unsigned long long tsc = __rdtsc();
+#endif
+    float check = 0.0f;
+    for (int b = 0; b < BLOCKS; b++) {
+        analysis.analyze(samples[b], &spectrum);
+        check += spectrum.peakHz;
+    }
+#if FFT_BENCH_TSC
+    tsc = __rdtsc() - tsc;
+#endif
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    float bands = 0.0f;
+    for (int i = 0; i < VIBRATION_BANDS; i++) {
+        bands += spectrum.bands[i];
+    }
+    printf("[FFT] N: %4d resolution: %6.2f Hz fft error: %.2e\n", N, SAMPLE_RATE / N, check_fft<N>());
+    printf("[FFT]   %8.0f ns/block", ns / BLOCKS);
+#if FFT_BENCH_TSC
+    printf(" %8llu TSC cycles/block", tsc / BLOCKS);
+#endif
+    printf(" (block period %.1f ms)\n", 1000.0f * N / SAMPLE_RATE);
+    printf("[FFT]   rms: %.4f g (expected %.4f) band sum: %.4f g^2 peak: %.1f Hz %.3f g (avg %.1f Hz)\n",
+        spectrum.rms, sqrtf(0.5f * 0.25f + 0.5f * 0.01f), bands, spectrum.peakHz, spectrum.peakAmplitude,
+        check / BLOCKS);
+}
+
+int main(int, char**) {
+    bench<64>();
+    bench<128>();
+    bench<256>();
+    bench<512>();
+    bench<1024>();
+    return 0;
+}
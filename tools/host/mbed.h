@@ -0,0 +1,475 @@
+#pragma once
+
+// Host stand-in for the mbed OS 5 API subset used by the MPU9250 driver and source/motion_sync.cpp, for host tools
+// such as tools/load_test.cpp. Not part of the firmware.
+//
+// Time is virtual: us_ticker_read(), Timer and every wait advance a simulated clock instead of sleeping. Host CPU
+// time spent between two clock reads is added to the clock, multiplied by host_clock().cpuScale, so that the code
+// under test costs (scaled) time like on the target. Bus transfers take the time computed by the I2C model of the
+// tool. There is a single thread: Thread::start() does not run anything, Ticker, Timeout and InterruptIn never fire,
+// and a wait on an unavailable Semaphore times out at once. Builds that need a second thread (MPU9250_SAMPLE_HUB,
+// MPU9250_VIBRATION) or interrupts (MPU9250_WAKE_ON_MOTION, MPU9250_ASYNC_I2C) are therefore not supported.
+#include <chrono>
+#include <random>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+
+#define DEVICE_I2C_ASYNCH 0
+#define DEVICE_INTERRUPTIN 1
+#define DEVICE_FLASH 0
+
+#define MBED_HEAP_STATS_ENABLED 0
+
+typedef int PinName;
+enum {
+    PB_9, PB_8, PA_10, PA_8, LED1, USBTX, USBRX, PC_13, PB_10, PB_3, PA_0, PA_1, D7,
+    NC = -1
+};
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = 1,
+    osPriorityHigh = 2,
+    osPriorityRealtime = 3
+} osPriority;
+
+typedef int32_t osStatus;
+enum {
+    osOK = 0,
+    osErrorResource = -3
+};
+
+#define osWaitForever 0xFFFFFFFFu
+#define DEFAULT_STACK_SIZE 4096
+#define OS_STACK_SIZE 4096
+
+// Virtual clock shared by every time source of the shim
+struct HostClock {
+    uint64_t ns = 0;
+    double cpuScale = 1.0;              // target time per host CPU time
+    uint32_t schedulerJitterUs = 0;     // extra delay of Thread::wait(), uniform in 0..schedulerJitterUs
+    std::mt19937 random;
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    int paused = 0;
+
+    /* Add the host CPU time since the last call */
+    void sync(void) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!paused) {
+            ns += (uint64_t) (std::chrono::duration<double, std::nano>(now - last).count() * cpuScale);
+        }
+        last = now;
+    }
+
+    void advance(uint64_t delayNs) {
+        sync();
+        ns += delayNs;
+    }
+
+    uint32_t us(void) {
+        sync();
+        return (uint32_t) (ns / 1000);
+    }
+
+    uint32_t jitterUs(uint32_t maxUs) {
+        return maxUs ? std::uniform_int_distribution<uint32_t>(0, maxUs)(random) : 0;
+    }
+};
+
+inline HostClock& host_clock(void) {
+    static HostClock clock;
+    return clock;
+}
+
+// Host CPU time within the scope is not charged to the clock (e.g. the simulated devices and the bookkeeping of a tool)
+class HostClockPause {
+public:
+    HostClockPause() {
+        host_clock().sync();
+        host_clock().paused++;
+    }
+
+    ~HostClockPause() {
+        host_clock().sync();
+        host_clock().paused--;
+    }
+};
+
+extern "C" inline uint32_t us_ticker_read(void) {
+    return host_clock().us();
+}
+
+extern "C" inline void core_util_critical_section_enter(void) {
+}
+
+extern "C" inline void core_util_critical_section_exit(void) {
+}
+
+inline void __DMB(void) {
+}
+
+inline void wait_us(int us) {
+    host_clock().advance((uint64_t) us * 1000);
+}
+
+inline void wait_ms(int ms) {
+    host_clock().advance((uint64_t) ms * 1000000);
+}
+
+inline void wait(float s) {
+    host_clock().advance((uint64_t) (s * 1e9f));
+}
+
+extern uint32_t SystemCoreClock;
+
+struct DWT_Type {
+    volatile uint32_t CTRL, CYCCNT;
+};
+
+struct CoreDebug_Type {
+    volatile uint32_t DEMCR;
+};
+
+inline DWT_Type* host_dwt(void) {
+    static DWT_Type dwt;
+    return &dwt;
+}
+
+inline CoreDebug_Type* host_core_debug(void) {
+    static CoreDebug_Type coreDebug;
+    return &coreDebug;
+}
+
+#define DWT (host_dwt())
+#define CoreDebug (host_core_debug())
+#define DWT_CTRL_CYCCNTENA_Msk 1u
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+
+// Function or member function without heap allocation
+template <typename F>
+class Callback;
+
+template <typename R, typename... A>
+class Callback<R(A...)> {
+    struct Member {
+        void* object;
+        char method[2 * sizeof(void*)];
+    };
+
+    R (*_thunk)(const Callback*, A...) = NULL;
+    R (*_function)(A...) = NULL;
+    Member _member;
+
+    static R callFunction(const Callback* self, A... args) {
+        return self->_function(args...);
+    }
+
+    template <typename T, typename M>
+    static R callMember(const Callback* self, A... args) {
+        M method;
+        memcpy(&method, self->_member.method, sizeof(method));
+        return (((T*) self->_member.object)->*method)(args...);
+    }
+
+public:
+    Callback() {
+    }
+
+    Callback(R (*function)(A...)): _thunk(&Callback::callFunction), _function(function) {
+    }
+
+    template <typename T, typename M>
+    Callback(T* object, M method): _thunk(&Callback::callMember<T, M>) {
+        static_assert(sizeof(M) <= sizeof(_member.method), "member function pointer too large");
+        _member.object = object;
+        memcpy(_member.method, &method, sizeof(method));
+    }
+
+    R call(A... args) const {
+        return _thunk(this, args...);
+    }
+
+    R operator()(A... args) const {
+        return call(args...);
+    }
+
+    operator bool() const {
+        return _thunk != NULL;
+    }
+};
+
+template <typename T, typename R, typename... A>
+Callback<R(A...)> callback(T* object, R (T::*method)(A...)) {
+    return Callback<R(A...)>(object, method);
+}
+
+template <typename R, typename... A>
+Callback<R(A...)> callback(R (*function)(A...)) {
+    return Callback<R(A...)>(function);
+}
+
+typedef Callback<void(int)> event_callback_t;
+
+// Device side of the I2C bus, implemented by the tool. Both return 0 on success like I2C::write()/read() and account
+// for the transfer time themselves (HostClock::advance()).
+int host_i2c_write(int hz, int address, const char* data, int length, bool repeated);
+int host_i2c_read(int hz, int address, char* data, int length, bool repeated);
+
+class I2C {
+    int _hz = 100000;
+
+public:
+    I2C(PinName, PinName) {
+    }
+
+    void frequency(int hz) {
+        _hz = hz;
+    }
+
+    int write(int address, const char* data, int length, bool repeated = false) {
+        return host_i2c_write(_hz, address, data, length, repeated);
+    }
+
+    int read(int address, char* data, int length, bool repeated = false) {
+        return host_i2c_read(_hz, address, data, length, repeated);
+    }
+};
+
+class Timer {
+    uint64_t _startNs = 0;
+    uint64_t _elapsedNs = 0;
+    bool _running = false;
+
+    uint64_t elapsedNs(void) {
+        host_clock().sync();
+        return _elapsedNs + (_running ? host_clock().ns - _startNs : 0);
+    }
+
+public:
+    void start(void) {
+        if (!_running) {
+            host_clock().sync();
+            _startNs = host_clock().ns;
+            _running = true;
+        }
+    }
+
+    void stop(void) {
+        _elapsedNs = elapsedNs();
+        _running = false;
+    }
+
+    void reset(void) {
+        host_clock().sync();
+        _startNs = host_clock().ns;
+        _elapsedNs = 0;
+    }
+
+    float read(void) {
+        return elapsedNs() / 1e9f;
+    }
+
+    int read_ms(void) {
+        return (int) (elapsedNs() / 1000000);
+    }
+
+    int read_us(void) {
+        return (int) (elapsedNs() / 1000);
+    }
+};
+
+class Ticker {
+public:
+    void attach_us(Callback<void()>, uint32_t) {
+    }
+
+    void detach(void) {
+    }
+};
+
+class Timeout {
+public:
+    void attach_us(Callback<void()>, uint32_t) {
+    }
+
+    void detach(void) {
+    }
+};
+
+enum PinDirection {
+    PIN_INPUT,
+    PIN_OUTPUT
+};
+
+enum PinMode {
+    PullUp,
+    PullNone,
+    OpenDrain,
+    PullDown
+};
+
+class DigitalOut {
+    int _value;
+
+public:
+    DigitalOut(PinName, int value = 0): _value(value) {
+    }
+
+    DigitalOut& operator=(int value) {
+        _value = value;
+        return *this;
+    }
+
+    operator int() {
+        return _value;
+    }
+};
+
+// Pins read high, i.e. an idle bus for i2c_bus_clear()
+class DigitalInOut {
+public:
+    DigitalInOut(PinName) {
+    }
+
+    DigitalInOut(PinName, PinDirection, PinMode, int) {
+    }
+
+    void output(void) {
+    }
+
+    void input(void) {
+    }
+
+    void mode(int) {
+    }
+
+    void write(int) {
+    }
+
+    int read(void) {
+        return 1;
+    }
+
+    DigitalInOut& operator=(int) {
+        return *this;
+    }
+
+    operator int() {
+        return 1;
+    }
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName) {
+    }
+
+    void rise(Callback<void()>) {
+    }
+
+    void fall(Callback<void()>) {
+    }
+
+    void enable_irq(void) {
+    }
+
+    void disable_irq(void) {
+    }
+
+    int read(void) {
+        return 0;
+    }
+};
+
+class Serial {
+public:
+    Serial(PinName, PinName, int = 9600) {
+    }
+
+    void baud(int) {
+    }
+};
+
+class Mutex {
+public:
+    osStatus lock(uint32_t = osWaitForever) {
+        return osOK;
+    }
+
+    bool trylock(void) {
+        return true;
+    }
+
+    osStatus unlock(void) {
+        return osOK;
+    }
+};
+
+class Semaphore {
+    int32_t _count;
+
+public:
+    Semaphore(int32_t count = 0): _count(count) {
+    }
+
+    /* Returns the tokens available before the wait like RTX, 0 if none (no other thread could release one) */
+    int32_t wait(uint32_t = osWaitForever) {
+        return _count > 0 ? _count-- : 0;
+    }
+
+    osStatus release(void) {
+        _count++;
+        return osOK;
+    }
+};
+
+class Thread {
+    uint32_t _stackSize;
+
+public:
+    Thread(osPriority = osPriorityNormal, uint32_t stackSize = DEFAULT_STACK_SIZE, unsigned char* = NULL):
+        _stackSize(stackSize) {
+    }
+
+    osStatus start(Callback<void()>) {
+        return osErrorResource;
+    }
+
+    osStatus join(void) {
+        return osOK;
+    }
+
+    /* The caller sleeps for `ms` plus the scheduler jitter */
+    static osStatus wait(uint32_t ms) {
+        HostClock& clock = host_clock();
+        clock.advance((uint64_t) ms * 1000000 + (uint64_t) clock.jitterUs(clock.schedulerJitterUs) * 1000);
+        return osOK;
+    }
+
+    static osStatus yield(void) {
+        return osOK;
+    }
+
+    uint32_t stack_size(void) {
+        return _stackSize;
+    }
+
+    uint32_t free_stack(void) {
+        return _stackSize;
+    }
+
+    uint32_t used_stack(void) {
+        return 0;
+    }
+
+    uint32_t max_stack(void) {
+        return 0;
+    }
+};
@@ -0,0 +1,383 @@
+// Host load test of the acquisition pipeline: the motion_sync loop (source/motion_sync.cpp) with the real MPU9250
+// driver, against a simulated sensor on a simulated I2C bus.
+//
+//   $ g++ -std=c++11 -O2 -Itools/host -I. -o load_test tools/load_test.cpp
+//   $ ./load_test [-t seconds] [-c cpu_scale] [-l bus_latency_us] [-j bus_jitter_us] [-s scheduler_jitter_us]
+//                 [-b baud] [-w loop_wait_ms] [-r rate_hz] [-v]
+//
+// The simulated MPU9250 produces a new accel/gyro sample at 200 Hz, 1 kHz and 8 kHz in turn (or the rate of -r),
+// whatever SMPLRT_DIV the driver configures; the AK8963 runs at 100 Hz. The loop runs like the sync thread of main():
+// mpu9250_sync_task(), then Thread::wait(loop_wait_ms). Time is virtual (tools/host/mbed.h):
+//   - host CPU time of the driver and the loop counts times cpu_scale, the speed ratio between the host and the
+//     target (about 25 for a desktop against the 100 MHz Cortex-M4 of the Nucleo F411RE; compare the fuse stage with
+//     the [MADGWICK] scalar cycles of `make benchmark` to calibrate it)
+//   - an I2C transfer takes 9 bits per byte (address included) at the bus frequency, plus bus_latency_us and a uniform
+//     random delay up to bus_jitter_us (clock stretching, other masters)
+//   - every Thread::wait() is late by a uniform random delay up to scheduler_jitter_us
+//   - the text output takes 10 bits per character at `baud` (115200 as in config.json, 0 for none)
+// The firmware output is discarded (-v copies it to stderr).
+//
+// Per rate the test reports:
+//   - dropped samples: produced by the sensor while the loop ran but never read, and reads of an already read sample
+//   - end-to-end latency percentiles: from the time the sensor produced the sample to the end of the loop iteration
+//   - time per stage (LoopMonitor): read (bus), convert, fuse and output per iteration and as a share of the run
+//
+// Builds that need a second thread or interrupts (MPU9250_SAMPLE_HUB, MPU9250_VIBRATION, MPU9250_WAKE_ON_MOTION,
+// MPU9250_ASYNC_I2C) are not supported by the single-threaded shim. Other flags can be given with -D, e.g.
+// -DMPU9250_OUTPUT_DIVIDER=50 or -DMPU9250_FUSION_FIXED_POINT=1.
+#define MPU9250_LOOP_MONITOR 1
+#define LOOP_MONITOR_REPORT_ITERATIONS 0xFFFFFFFF     // the test prints its own report
+#include "mbed.h"
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "source/motion_sync.cpp"
+
+#if MPU9250_SAMPLE_HUB || MPU9250_VIBRATION || MPU9250_WAKE_ON_MOTION
+#error "the load test runs a single thread without interrupts"
+#endif
+
+uint32_t SystemCoreClock = 100000000;
+
+#define MAG_PERIOD_NS 10000000ull       // AK8963 continuous measurement mode 2, 100 Hz
+
+struct LoadConfig {
+    double seconds = 10.0;
+    double cpuScale = 25.0;
+    uint32_t busLatencyUs = 0;
+    uint32_t busJitterUs = 0;
+    uint32_t schedulerJitterUs = 0;
+    uint32_t baud = 115200;
+    uint32_t loopWaitMs = 1;
+    bool verbose = false;
+};
+
+static LoadConfig config;
+
+// Register model of the MPU9250 and the AK8963 with synthetic motion. Registers without a model are plain memory.
+//
+// The device lies flat (sensor z up). Once the run starts it turns about the vertical axis at YAW_RATE; before that it
+// is still for the accel/gyro calibration while the magnetic field sweeps all axes for the mag calibration.
+class SimulatedIMU {
+    static constexpr double YAW_RATE = 1.0;            // rad/s
+    static constexpr double MAG_LSB_PER_UT = 1.0 / 0.15;
+
+    uint8_t _regs[128];
+    uint8_t _akRegs[32];
+    uint8_t _pointer = 0;
+    uint8_t _akPointer = 0;
+    double _rate = 200.0;
+    uint64_t _originNs = 0;             // time of sample 0
+    bool _moving = false;
+    uint64_t _magReadNs = 0;            // time of the mag sample last read
+    uint64_t _readyIndex = 0;           // sample at the last INT_STATUS read, which clears RAW_DATA_RDY_INT
+    std::mt19937 _random;
+    std::normal_distribution<double> _noise;
+
+    // Sensor z up: the accelerometer measures +1 g on z, the gyro the yaw rate
+    void sample(uint64_t index, uint8_t* out, bool temp) {
+        int fsAccel = (_regs[ACCEL_CONFIG] >> 3) & 0x03, fsGyro = (_regs[GYRO_CONFIG] >> 3) & 0x03;
+        double lsbPerG = 16384 >> fsAccel, lsbPerRad = (131.0 / DEG_TO_RAD) / (1 << fsGyro);
+        double rate = _moving ? YAW_RATE : 0.0;
+        double values[6] = {
+            0.0, 0.0, lsbPerG,
+            0.0, 0.0, rate * lsbPerRad
+        };
+        (void) index;
+        int n = 0;
+        for (int i = 0; i < 6; i++) {
+            int16_t v = (int16_t) lrint(values[i] + 4.0 * _noise(_random));
+            if (i == 3 && temp) {
+                out[n++] = 0;           // TEMP_OUT, 21 degC
+                out[n++] = 0;
+            }
+            out[n++] = (uint8_t) (v >> 8);
+            out[n++] = (uint8_t) v;
+        }
+    }
+
+    void magSample(uint64_t nowNs, uint8_t* out) {
+        double t = nowNs / 1e9, m[3];
+        if (_moving) {
+            double yaw = YAW_RATE * (nowNs - _originNs) / 1e9;
+            m[0] = 20.0 * cos(yaw);
+            m[1] = -20.0 * sin(yaw);
+            m[2] = -40.0;
+        } else {
+            m[0] = 45.0 * cos(2.0 * M_PI * t / 1.5);
+            m[1] = 45.0 * sin(2.0 * M_PI * t / 1.5);
+            m[2] = 45.0 * cos(2.0 * M_PI * t / 1.1);
+        }
+        for (int i = 0; i < 3; i++) {
+            int16_t v = (int16_t) lrint(m[i] * MAG_LSB_PER_UT + 2.0 * _noise(_random));
+            out[2 * i] = (uint8_t) v;   // little endian
+            out[2 * i + 1] = (uint8_t) (v >> 8);
+        }
+        out[6] = 0x10;                  // ST2: 16-bit output, no overflow
+    }
+
+    // INT_STATUS: data ready once per new sample of the run, always before it (calibration)
+    uint8_t intStatus(uint64_t nowNs) {
+        if (!_moving) {
+            return 0x01;
+        }
+        uint64_t index = indexAt(nowNs);
+        bool ready = index != _readyIndex;
+        _readyIndex = index;
+        return ready;
+    }
+
+public:
+    // Samples served to reads of ACCEL_XOUT_H in the current run
+    uint64_t lastIndex = 0;
+    bool served = false;                // a sample was read since the flag was cleared
+    uint64_t reads = 0;
+    uint64_t staleReads = 0;
+    uint64_t distinct = 0;
+    uint64_t firstIndex = 0;
+
+    SimulatedIMU() {
+        memset(_regs, 0, sizeof(_regs));
+        memset(_akRegs, 0, sizeof(_akRegs));
+        _regs[PWR_MGMT_1] = 0x01;
+        _akRegs[AK8963_ASAX] = _akRegs[AK8963_ASAX + 1] = _akRegs[AK8963_ASAX + 2] = 128;
+    }
+
+    /* Start a run with `rate` samples per second from now on */
+    void start(double rate, uint64_t nowNs) {
+        _rate = rate;
+        _originNs = nowNs;
+        _moving = true;
+        _readyIndex = 0;
+        reads = staleReads = distinct = 0;
+        served = false;
+    }
+
+    uint64_t indexAt(uint64_t nowNs) {
+        return (uint64_t) ((nowNs - _originNs) * _rate / 1e9);
+    }
+
+    uint64_t timeOf(uint64_t index) {
+        return _originNs + (uint64_t) (index * 1e9 / _rate);
+    }
+
+    int write(int address, const char* data, int length) {
+        if (address == MPU9250_ADDRESS) {
+            _pointer = data[0] & 0x7F;
+            for (int i = 1; i < length; i++, _pointer = (_pointer + 1) & 0x7F) {
+                // The reset bit clears itself
+                _regs[_pointer] = _pointer == PWR_MGMT_1 ? data[i] & 0x7F : data[i];
+            }
+            return 0;
+        }
+        if (address == AK8963_ADDRESS) {
+            _akPointer = data[0] & 0x1F;
+            for (int i = 1; i < length; i++, _akPointer = (_akPointer + 1) & 0x1F) {
+                _akRegs[_akPointer] = data[i];
+            }
+            return 0;
+        }
+        return 1;                       // NACK
+    }
+
+    int read(int address, uint8_t* data, int length, uint64_t nowNs) {
+        if (address == AK8963_ADDRESS) {
+            if (_akPointer == AK8963_XOUT_L) {
+                uint8_t mag[7];
+                magSample(nowNs, mag);
+                memcpy(data, mag, length < 7 ? length : 7);
+                _magReadNs = nowNs - nowNs % MAG_PERIOD_NS;
+                return 0;
+            }
+            for (int i = 0; i < length; i++) {
+                uint8_t reg = (_akPointer + i) & 0x1F;
+                data[i] = reg == WHO_AM_I_AK8963 ? 0x48
+                    : reg == AK8963_ST1 ? nowNs - _magReadNs >= MAG_PERIOD_NS : _akRegs[reg];
+            }
+            return 0;
+        }
+        if (address != MPU9250_ADDRESS) {
+            return 1;
+        }
+        if (_pointer == ACCEL_XOUT_H && length >= 14) {
+            uint64_t index = _moving ? indexAt(nowNs) : 0;
+            sample(index, data, true);
+            memset(data + 14, 0, length - 14);
+            if (_moving) {
+                if (reads > 0 && index == lastIndex) {
+                    staleReads++;
+                } else {
+                    if (reads == 0) {
+                        firstIndex = index;
+                    }
+                    distinct++;
+                }
+                reads++;
+                lastIndex = index;
+                served = true;
+            }
+            return 0;
+        }
+        if (_pointer == FIFO_COUNTH) {
+            data[0] = 480 >> 8;         // 40 accel/gyro records of accelgyrocalMPU9250()
+            data[1] = 480 & 0xFF;
+            return 0;
+        }
+        if (_pointer == FIFO_R_W) {
+            uint8_t record[14];
+            sample(0, record, false);
+            memcpy(data, record, length < 12 ? length : 12);
+            return 0;
+        }
+        for (int i = 0; i < length; i++) {
+            uint8_t reg = (_pointer + i) & 0x7F;
+            data[i] = reg == WHO_AM_I_MPU9250 ? 0x71 : reg == INT_STATUS ? intStatus(nowNs) : _regs[reg];
+        }
+        return 0;
+    }
+};
+
+static SimulatedIMU imu;
+
+// (1 + length) bytes of 9 bits at `hz`, plus the injected latency
+static void bus_transfer(int hz, int length) {
+    HostClock& clock = host_clock();
+    uint64_t ns = (uint64_t) (1 + length) * 9 * 1000000000ull / (uint64_t) hz;
+    ns += (uint64_t) (config.busLatencyUs + clock.jitterUs(config.busJitterUs)) * 1000;
+    clock.advance(ns);
+}
+
+int host_i2c_write(int hz, int address, const char* data, int length, bool) {
+    HostClockPause pause;
+    bus_transfer(hz, length);
+    return imu.write(address, data, length);
+}
+
+int host_i2c_read(int hz, int address, char* data, int length, bool) {
+    HostClockPause pause;
+    bus_transfer(hz, length);
+    // The data is latched at the start of the transfer
+    return imu.read(address, (uint8_t*) data, length, host_clock().ns);
+}
+
+// Serial port: every character written by the firmware costs 10 bits at config.baud
+static ssize_t uart_write(void*, const char* buffer, size_t size) {
+    HostClockPause pause;
+    if (config.verbose) {
+        fwrite(buffer, 1, size, stderr);
+    }
+    if (config.baud) {
+        host_clock().advance((uint64_t) size * 10 * 1000000000ull / config.baud);
+    }
+    return size;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t k = (size_t) (p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static void run(FILE* report, double rate) {
+    static const char* names[LOOP_STAGE_COUNT] = {"read", "convert", "fuse", "output"};
+    HostClock& clock = host_clock();
+    std::vector<uint32_t> latencies;
+    latencies.reserve((size_t) (config.seconds * rate) + 1);
+
+    uint64_t startNs, endNs;
+    {
+        HostClockPause pause;
+        startNs = clock.ns;
+        endNs = startNs + (uint64_t) (config.seconds * 1e9);
+        imu.start(rate, startNs);
+        loop_monitor.reset();
+    }
+    while (clock.ns < endNs) {
+        mpu9250_sync_task();
+        HostClockPause pause;
+        if (imu.served) {
+            imu.served = false;
+            latencies.push_back((uint32_t) ((clock.ns - imu.timeOf(imu.lastIndex)) / 1000));
+        }
+        Thread::wait(config.loopWaitMs);
+    }
+
+    HostClockPause pause;
+    uint64_t produced = imu.indexAt(clock.ns) - imu.firstIndex + 1;
+    uint64_t dropped = produced - imu.distinct;
+    const LoopStats& stats = loop_monitor.getStats();
+    double durationUs = (clock.ns - startNs) / 1000.0;
+    uint32_t n = stats.iterations ? stats.iterations : 1;
+    fprintf(report, "[LOAD] rate: %.0f Hz duration: %.1f s iterations: %lu\r\n", rate, durationUs / 1e6,
+        (unsigned long) stats.iterations);
+    fprintf(report, "[LOAD] samples: %llu read: %llu dropped: %llu (%.1f %%) stale reads: %llu\r\n",
+        (unsigned long long) produced, (unsigned long long) imu.distinct, (unsigned long long) dropped,
+        100.0 * dropped / produced, (unsigned long long) imu.staleReads);
+    fprintf(report, "[LOAD] latency p50: %lu us p90: %lu us p99: %lu us max: %lu us\r\n",
+        (unsigned long) percentile(latencies, 0.5), (unsigned long) percentile(latencies, 0.9),
+        (unsigned long) percentile(latencies, 0.99), (unsigned long) percentile(latencies, 1.0));
+    for (int i = 0; i < LOOP_STAGE_COUNT; i++) {
+        const LoopStageStats& s = stats.stages[i];
+        fprintf(report, "[LOAD] %-7s avg: %6lu us max: %6lu us time: %5.1f %%\r\n", names[i],
+            (unsigned long) (s.totalUs / n), (unsigned long) s.maxUs, 100.0 * s.totalUs / durationUs);
+    }
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-t seconds] [-c cpu_scale] [-l bus_latency_us] [-j bus_jitter_us] "
+        "[-s scheduler_jitter_us] [-b baud] [-w loop_wait_ms] [-r rate_hz] [-v]\n", name);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    double rates[3] = {200.0, 1000.0, 8000.0};
+    int rateCount = 3;
+    int option;
+    while ((option = getopt(argc, argv, "t:c:l:j:s:b:w:r:v")) != -1) {
+        switch (option) {
+            case 't': config.seconds = atof(optarg); break;
+            case 'c': config.cpuScale = atof(optarg); break;
+            case 'l': config.busLatencyUs = atoi(optarg); break;
+            case 'j': config.busJitterUs = atoi(optarg); break;
+            case 's': config.schedulerJitterUs = atoi(optarg); break;
+            case 'b': config.baud = atoi(optarg); break;
+            case 'w': config.loopWaitMs = atoi(optarg); break;
+            case 'r': rates[0] = atof(optarg); rateCount = 1; break;
+            case 'v': config.verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (config.seconds <= 0.0 || config.cpuScale < 0.0 || rates[0] <= 0.0) {
+        usage(argv[0]);
+    }
+
+    // The report keeps the real stdout, the firmware writes to the simulated serial port
+    FILE* report = fdopen(dup(fileno(stdout)), "w");
+    cookie_io_functions_t uart = {NULL, uart_write, NULL, NULL};
+    stdout = fopencookie(NULL, "w", uart);
+    setvbuf(stdout, NULL, _IOLBF, 256);
+
+    HostClock& clock = host_clock();
+    clock.cpuScale = config.cpuScale;
+    clock.schedulerJitterUs = config.schedulerJitterUs;
+    fprintf(report, "[LOAD] cpu scale: %.1f bus latency: %lu+0..%lu us scheduler jitter: 0..%lu us baud: %lu "
+        "loop wait: %lu ms output divider: %d\r\n", config.cpuScale, (unsigned long) config.busLatencyUs,
+        (unsigned long) config.busJitterUs, (unsigned long) config.schedulerJitterUs, (unsigned long) config.baud,
+        (unsigned long) config.loopWaitMs, MPU9250_OUTPUT_DIVIDER);
+
+    mpu9250_sync_task_init();
+    while (!motion_sensor->isInitialized()) {
+        mpu9250_sync_task();
+    }
+    fprintf(report, "[LOAD] initialized in %lu ms\r\n", (unsigned long) (clock.us() / 1000));
+    for (int i = 0; i < rateCount; i++) {
+        run(report, rates[i]);
+    }
+    fflush(stdout);
+    fclose(report);
+    return 0;
+}
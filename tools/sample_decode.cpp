@@ -0,0 +1,85 @@
+// Host decoder for the compressed sample stream (MPU9250_LOG_COMPRESSED=1).
+//
+//   $ g++ -std=c++11 -O2 -I. -o sample_decode tools/sample_decode.cpp
+//   $ ./sample_decode < capture.bin > samples.csv
+//
+// Reads blocks from stdin, skipping anything between them (boot messages, damaged blocks),
+// and writes one CSV line per frame: its sequence number, the timestamp (us) of the first frame of its block and the
+// raw register values. Frames missing between the decoded blocks are counted from the sequence numbers.
+#include <stdio.h>
+#include <string.h>
+#include "mpu-9250/sample_codec.hpp"
+
+static uint8_t block[SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_FRAMES * SAMPLE_CODEC_MAX_FRAME_SIZE +
+                     SAMPLE_CODEC_TRAILER_SIZE];
+static size_t have = 0;
+
+// Drop `count` bytes from the front of the buffer
+static void consume(size_t count) {
+    have -= count;
+    memmove(block, &block[count], have);
+}
+
+// Drop the first byte and everything up to the next sync byte, so that a block starting inside a rejected
+// candidate (e.g. a sync pair in a damaged block) is still found
+static void resync(void) {
+    size_t skip = 1;
+    while (skip < have && block[skip] != SAMPLE_CODEC_SYNC0) {
+        skip++;
+    }
+    consume(skip);
+}
+
+int main(int, char**) {
+    SampleDecoder decoder;
+    SampleFrame frame;
+    unsigned long blocks = 0, frames = 0, rejected = 0, missing = 0;
+    uint32_t expected = 0;
+    int c;
+
+    printf("sample,block_us,ax,ay,az,temp,gx,gy,gz,mx,my,mz\n");
+    while ((c = getchar()) != EOF) {
+        block[have++] = (uint8_t) c;
+        // After a resync the buffer may already hold the next block
+        while (have > 0) {
+            if (block[0] != SAMPLE_CODEC_SYNC0 || (have >= 2 && block[1] != SAMPLE_CODEC_SYNC1)) {
+                resync();
+                continue;
+            }
+            if (have < SAMPLE_CODEC_HEADER_SIZE) {
+                break;
+            }
+            size_t length = SampleDecoder::blockLength(block);
+            if (length == 0) {
+                rejected++;
+                resync();
+                continue;
+            }
+            if (have < length) {
+                break;
+            }
+            if (!decoder.begin(block, length)) {
+                rejected++;
+                resync();
+                continue;
+            }
+            uint32_t sequence = decoder.getSequence();
+            int32_t skipped = (int32_t) (sequence - expected);
+            if (blocks++ && skipped > 0) {
+                missing += skipped;     // a step back is a restart of the firmware
+            }
+            while (decoder.next(&frame)) {
+                printf("%lu,%lu", (unsigned long) sequence++, (unsigned long) decoder.getTimestamp());
+                for (int i = 0; i < SAMPLE_FRAME_CHANNELS; i++) {
+                    printf(",%d", frame.values[i]);
+                }
+                printf("\n");
+                frames++;
+            }
+            expected = sequence;
+            consume(length);
+        }
+    }
+    fprintf(stderr, "blocks: %lu frames: %lu rejected: %lu missing frames: %lu\n", blocks, frames, rejected, missing);
+    return 0;
+}